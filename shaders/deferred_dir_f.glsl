@@ -0,0 +1,51 @@
+#version 450 core
+// Directional light over the whole G-buffer, see DeferredRenderer
+
+struct DirLight {
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+out vec4 frag_color;
+
+layout (binding = 0) uniform sampler2D gbuffer_albedo;
+layout (binding = 1) uniform sampler2D gbuffer_normal;
+layout (binding = 2) uniform sampler2D gbuffer_depth;
+uniform mat4 inverse_view_projection;
+uniform vec2 screen_size;
+uniform vec3 view_pos;
+uniform DirLight dir_light;
+
+vec3 decode_octahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbuffer_depth, texel, 0).r;
+	// Nothing was drawn here
+	if (depth == 1.0) discard;
+
+	vec4 ndc = vec4(gl_FragCoord.xy / screen_size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	vec4 world = inverse_view_projection * ndc;
+	vec3 frag_pos = world.xyz / world.w;
+	vec4 albedo = texelFetch(gbuffer_albedo, texel, 0);
+	vec4 packed_normal = texelFetch(gbuffer_normal, texel, 0);
+	vec3 normal = decode_octahedral(packed_normal.xy);
+	vec3 view_dir = normalize(view_pos - frag_pos);
+
+	// Same terms as calc_dir_light in frag.glsl
+	vec3 light_dir = normalize(-dir_light.direction);
+	float diff = max(dot(normal, light_dir), 0.0);
+	vec3 reflect_dir = reflect(-light_dir, normal);
+	float spec = pow(max(dot(view_dir, reflect_dir), 0.0), packed_normal.z);
+	vec3 ambient = dir_light.ambient * albedo.rgb;
+	vec3 diffuse = dir_light.diffuse * diff * albedo.rgb;
+	vec3 specular = dir_light.specular * spec * albedo.rgb;
+	frag_color = vec4(ambient + diffuse + specular, 1.0);
+}
@@ -0,0 +1,60 @@
+#version 450 core
+// Adds one point light where its volume covers the G-buffer, see DeferredRenderer
+
+// See GpuPointLight in point_light.hpp
+struct PointLightData {
+	vec4 pos; // w: constant
+	vec4 ambient; // w: linear
+	vec4 diffuse; // w: quadratic
+	vec4 specular; // w: range
+};
+layout (std430, binding = 2) readonly buffer PointLights {
+	PointLightData point_lights[];
+};
+
+out vec4 frag_color;
+flat in int light_index;
+
+layout (binding = 0) uniform sampler2D gbuffer_albedo;
+layout (binding = 1) uniform sampler2D gbuffer_normal;
+layout (binding = 2) uniform sampler2D gbuffer_depth;
+uniform mat4 inverse_view_projection;
+uniform vec2 screen_size;
+uniform vec3 view_pos;
+
+vec3 decode_octahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbuffer_depth, texel, 0).r;
+	vec4 ndc = vec4(gl_FragCoord.xy / screen_size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	vec4 world = inverse_view_projection * ndc;
+	vec3 frag_pos = world.xyz / world.w;
+
+	PointLightData light = point_lights[light_index];
+	float distance = length(light.pos.xyz - frag_pos);
+	// The volume is a cube, skip its corners
+	if (distance > light.specular.w) discard;
+
+	vec4 albedo = texelFetch(gbuffer_albedo, texel, 0);
+	vec4 packed_normal = texelFetch(gbuffer_normal, texel, 0);
+	vec3 normal = decode_octahedral(packed_normal.xy);
+	vec3 view_dir = normalize(view_pos - frag_pos);
+
+	// Same terms as calc_point_light in frag.glsl
+	vec3 light_dir = normalize(light.pos.xyz - frag_pos);
+	float diff = max(dot(normal, light_dir), 0.0);
+	vec3 reflect_dir = reflect(-light_dir, normal);
+	float spec = pow(max(dot(view_dir, reflect_dir), 0.0), packed_normal.z);
+	float attenuation = 1.0 / (light.pos.w + light.ambient.w * distance + light.diffuse.w * (distance * distance));
+
+	vec3 ambient = light.ambient.xyz * albedo.rgb;
+	vec3 diffuse = light.diffuse.xyz * diff * albedo.rgb;
+	vec3 specular = light.specular.xyz * spec * albedo.a;
+	frag_color = vec4((ambient + diffuse + specular) * attenuation, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450 core
+// One light volume per instance, see DeferredRenderer
+layout (location = 0) in vec3 aPos;
+
+// See GpuPointLight in point_light.hpp
+struct PointLightData {
+    vec4 pos; // w: constant
+    vec4 ambient; // w: linear
+    vec4 diffuse; // w: quadratic
+    vec4 specular; // w: range
+};
+layout (std430, binding = 2) readonly buffer PointLights {
+    PointLightData point_lights[];
+};
+
+flat out int light_index;
+uniform mat4 view_projection;
+uniform float max_range;
+
+void main()
+{
+    PointLightData light = point_lights[gl_InstanceID];
+    // The unit cube around the light's range sphere
+    float range = min(light.specular.w, max_range);
+    gl_Position = view_projection * vec4(light.pos.xyz + aPos * range, 1.0);
+    light_index = gl_InstanceID;
+}
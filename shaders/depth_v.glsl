@@ -0,0 +1,41 @@
+#version 450 core
+// Depth pre-pass, position stream only. gl_Position is computed exactly as in vert.glsl and
+// vert_indirect.glsl so the main pass can depth test with GL_EQUAL.
+layout (location = 0) in vec3 aPos;
+#ifdef INDIRECT_DRAWS
+layout (location = 3) in uint draw_id;
+#endif
+
+invariant gl_Position;
+uniform mat4 view;
+uniform mat4 projection;
+
+#ifdef INDIRECT_DRAWS
+// See DrawData in indirect_draws.hpp
+struct DrawData {
+    mat4 model;
+    mat4 normal_matrix;
+    vec4 pos_offset;
+    vec4 pos_scale;
+    uint material;
+};
+layout (std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+#else
+uniform mat4 model;
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
+#endif
+
+void main()
+{
+#ifdef INDIRECT_DRAWS
+    DrawData draw = draws[draw_id];
+    vec3 pos = draw.pos_offset.xyz + aPos * draw.pos_scale.xyz;
+    gl_Position = projection * view * draw.model * vec4(pos, 1.0);
+#else
+    vec3 pos = pos_offset + aPos * pos_scale;
+    gl_Position = projection * view * model * vec4(pos,1.0);
+#endif
+}
@@ -1,4 +1,8 @@
-#version 330 core
+#version 450 core
+// Shader::create defines MATERIAL_BINDLESS or MATERIAL_ARRAYS, both imply MATERIAL_TABLE
+#ifdef MATERIAL_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 
 struct PointLight {
   vec3 pos;
@@ -11,13 +15,52 @@ struct PointLight {
 	float quadratic;
 };
 struct Material {
+#ifndef MATERIAL_TABLE
   sampler2D texture_diffuse[8];
   sampler2D texture_specular[8];
   int diff_number;
   int spec_number;
+#endif
   float shininess;
 };
 
+#ifdef MATERIAL_TABLE
+// See MaterialRecord in material_table.hpp
+struct MaterialRecord {
+  uvec2 diffuse[4];
+  uvec2 specular[4];
+  int diff_number;
+  int spec_number;
+};
+layout (std430, binding = 1) readonly buffer Materials {
+  MaterialRecord materials[];
+};
+flat in uint material_id;
+
+#ifdef MATERIAL_BINDLESS
+vec4 sample_material(uvec2 handle, vec2 uv) {
+  return texture(sampler2D(handle), uv);
+}
+#else
+uniform sampler2DArray material_arrays[8];
+// x: array, y: layer. Textures that didn't fit an array sample white.
+vec4 sample_material(uvec2 slot, vec2 uv) {
+  vec3 coord = vec3(uv, float(slot.y));
+  switch (slot.x) {
+  case 0u: return texture(material_arrays[0], coord);
+  case 1u: return texture(material_arrays[1], coord);
+  case 2u: return texture(material_arrays[2], coord);
+  case 3u: return texture(material_arrays[3], coord);
+  case 4u: return texture(material_arrays[4], coord);
+  case 5u: return texture(material_arrays[5], coord);
+  case 6u: return texture(material_arrays[6], coord);
+  case 7u: return texture(material_arrays[7], coord);
+  }
+  return vec4(1.0);
+}
+#endif
+#endif
+
 struct DirLight {
 	vec3 direction;
 	vec3 ambient;
@@ -25,41 +68,112 @@ struct DirLight {
 	vec3 specular;
 };
 
+#ifdef DEFERRED_GBUFFER
+// See DeferredRenderer, lighting happens in deferred_dir_f.glsl and deferred_light_f.glsl
+layout (location = 0) out vec4 gbuffer_albedo; // rgb: diffuse, a: specular
+layout (location = 1) out vec4 gbuffer_normal; // xy: octahedral normal, z: shininess
+
+vec2 encode_octahedral(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.xy;
+  if (n.z < 0.0) e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return e;
+}
+#else
 out vec4 frag_color;
+#endif
 in vec2 tex_cord;
 in vec3 normal;
 in vec3 frag_pos;
 
 uniform vec3 view_pos;
 uniform Material material;
-uniform PointLight point_lights[64];
+// See GpuPointLight in point_light.hpp
+struct PointLightData {
+  vec4 pos; // w: constant
+  vec4 ambient; // w: linear
+  vec4 diffuse; // w: quadratic
+  vec4 specular; // w: range
+};
+layout (std430, binding = 2) readonly buffer PointLights {
+  PointLightData point_lights[];
+};
+
+#ifdef CLUSTERED_LIGHTS
+// See ClusteredLights and cluster_lights.comp
+layout (std430, binding = 3) readonly buffer ClusterLights {
+  uint cluster_lights[];
+};
+uniform mat4 view;
+uniform uvec3 cluster_grid;
+uniform uint cluster_stride;
+uniform float cluster_near;
+uniform float cluster_far;
+uniform vec2 screen_size;
+#endif
 uniform DirLight dir_light;
 uniform int point_light_num;
 
 vec3 calc_point_light(PointLight light, vec3 normal, vec3 frag_pos, vec3 view_dir, vec3 diff_texture, vec3 spec_texture);
 vec3 calc_dir_light(DirLight light, vec3 normal, vec3 view_dir, vec3 diff_texture, vec3 spec_texture);
 
+PointLight unpack_point_light(int i) {
+  PointLightData data = point_lights[i];
+  return PointLight(
+      data.pos.xyz, data.ambient.xyz, data.diffuse.xyz, data.specular.xyz,
+      data.pos.w, data.ambient.w, data.diffuse.w);
+}
+
 
 void main() {
   vec4 diff_texture = vec4(1.0);
+  vec4 spec_texture = vec4(1.0);
+#ifdef MATERIAL_TABLE
+  MaterialRecord record = materials[material_id];
+  for(int i = 0; i < record.diff_number; i++) {
+      diff_texture *= sample_material(record.diffuse[i], tex_cord);
+  }
+  for(int i = 0; i < record.spec_number; i++) {
+      spec_texture *= sample_material(record.specular[i], tex_cord);
+  }
+#else
   for(int i = 0; i < material.diff_number; i++) {
       diff_texture *= texture(material.texture_diffuse[i], tex_cord);
   }
-  vec4 spec_texture = vec4(1.0);
   for(int i = 0; i < material.spec_number; i++) {
       spec_texture *= texture(material.texture_specular[i], tex_cord);
   }
+#endif
 
   vec3 norm = normalize(normal);
   vec3 view_dir = normalize(view_pos - frag_pos);
 
+#ifdef DEFERRED_GBUFFER
+  gbuffer_albedo = vec4(diff_texture.rgb, spec_texture.r);
+  gbuffer_normal = vec4(encode_octahedral(norm), material.shininess, 0.0);
+#else
 	vec3 res = calc_dir_light(dir_light, norm, view_dir, vec3(diff_texture), vec3(spec_texture));
 
+#ifdef CLUSTERED_LIGHTS
+	float depth = max(-(view * vec4(frag_pos, 1.0)).z, cluster_near);
+	float slice = log(depth / cluster_near) / log(cluster_far / cluster_near);
+	uvec3 cell = min(
+	    uvec3(gl_FragCoord.xy / screen_size * vec2(cluster_grid.xy), slice * float(cluster_grid.z)),
+	    cluster_grid - 1u);
+	uint base = (cell.x + cluster_grid.x * (cell.y + cluster_grid.y * cell.z)) * cluster_stride;
+	uint count = cluster_lights[base];
+	for (uint i = 0u; i < count; i++) {
+		int light = int(cluster_lights[base + 1u + i]);
+		res += calc_point_light(unpack_point_light(light), normal, frag_pos, view_dir, vec3(diff_texture), vec3(spec_texture));
+	}
+#else
 	for (int i = 0; i < point_light_num; i++) {
-		res += calc_point_light(point_lights[i], normal, frag_pos, view_dir, vec3(diff_texture), vec3(spec_texture));
+		res += calc_point_light(unpack_point_light(i), normal, frag_pos, view_dir, vec3(diff_texture), vec3(spec_texture));
 	}
+#endif
 
   frag_color = vec4(res,1.0);
+#endif
 }
 
 
@@ -1,9 +1,16 @@
-
-#version 330 core
+#version 450 core
 out vec4 FragColor;
+#ifdef INSTANCED
+flat in vec3 instance_color;
+#else
 uniform vec3 lightColor;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+  FragColor = vec4(instance_color,1.0f);
+#else
   FragColor = vec4(lightColor,1.0f);
+#endif
 }
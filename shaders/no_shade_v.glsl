@@ -1,11 +1,33 @@
-#version 330 core
+#version 450 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
+
+#ifdef INSTANCED
+// See InstanceData in instance_buffer.hpp
+struct InstanceData {
+    mat4 model;
+    vec4 color;
+};
+layout (std430, binding = 7) readonly buffer Instances {
+    InstanceData instances[];
+};
+// World matrix of the mesh's node within its model
+uniform mat4 node;
+flat out vec3 instance_color;
+#else
+uniform mat4 model;
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos,1.0);
+#ifdef INSTANCED
+    InstanceData instance = instances[gl_InstanceID];
+    mat4 model = instance.model * node;
+    instance_color = instance.color.rgb;
+#endif
+    gl_Position = projection * view * model * vec4(pos_offset + aPos * pos_scale,1.0);
 }
@@ -3,6 +3,8 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCord;
 
+// Depth pre-pass draws have to land on exactly the same depth, see depth_v.glsl
+invariant gl_Position;
 out vec2 tex_cord;
 out vec3 normal;
 out vec3 frag_pos;
@@ -10,12 +12,30 @@ uniform mat4 model;
 uniform mat3 normalMatrix;
 uniform mat4 view;
 uniform mat4 projection;
+// CompactVertex decode, see Mesh
+uniform bool compact_vertices;
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
+#ifdef MATERIAL_TABLE
+uniform uint material_index;
+flat out uint material_id;
+#endif
 
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos,1.0);
+    vec3 pos = pos_offset + aPos * pos_scale;
+    gl_Position = projection * view * model * vec4(pos,1.0);
     tex_cord = aTexCord;
-    frag_pos = vec3(model * vec4(aPos, 1.0));
-    normal = normalMatrix * aNormal;
+    frag_pos = vec3(model * vec4(pos, 1.0));
+    normal = normalMatrix * (compact_vertices ? decode_octahedral(aNormal.xy) : aNormal);
+#ifdef MATERIAL_TABLE
+    material_id = material_index;
+#endif
 }
@@ -0,0 +1,46 @@
+#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCord;
+// Counts up from the command's base instance, see GeometryPool::max_draw_ids
+layout (location = 3) in uint draw_id;
+
+// Depth pre-pass draws have to land on exactly the same depth, see depth_v.glsl
+invariant gl_Position;
+out vec2 tex_cord;
+out vec3 normal;
+out vec3 frag_pos;
+flat out uint material_id;
+uniform mat4 view;
+uniform mat4 projection;
+
+// Per-draw data, see DrawData in indirect_draws.hpp
+struct DrawData {
+    mat4 model;
+    mat4 normal_matrix;
+    vec4 pos_offset; // w: CompactVertex mesh
+    vec4 pos_scale;
+    uint material;
+};
+layout (std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    DrawData draw = draws[draw_id];
+    vec3 pos = draw.pos_offset.xyz + aPos * draw.pos_scale.xyz;
+    gl_Position = projection * view * draw.model * vec4(pos, 1.0);
+    tex_cord = aTexCord;
+    frag_pos = vec3(draw.model * vec4(pos, 1.0));
+    vec3 n = draw.pos_offset.w != 0.0 ? decode_octahedral(aNormal.xy) : aNormal;
+    normal = mat3(draw.normal_matrix) * n;
+    material_id = draw.material;
+}
@@ -2,6 +2,8 @@
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include "app.hpp"
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <ctime>
 #include <string>
@@ -19,12 +21,30 @@
 #include "errorReporting.hpp"
 #include <stb/image.h>
 #include "camera.hpp"
+#include "clustered_lights.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <model.hpp>
+#include "geometry_pool.hpp"
+#include "gpu_scene.hpp"
+#include "hi_z_buffer.hpp"
+#include "indirect_draws.hpp"
+#include "loose_octree.hpp"
+#include "material_table.hpp"
+#include "render_queue.hpp"
+#include "texture_cache.hpp"
+#include "transform_hierarchy.hpp"
 #include "point_light.hpp"
 #include "dir_light.hpp"
+#include "deferred_renderer.hpp"
+#include "depth_prepass.hpp"
+
+namespace {
+// How the scene's point lights are shaded
+enum class LightPath { Forward, Clustered, Deferred };
+constexpr const char* light_path_names[] = {"Forward", "Clustered forward", "Deferred"};
+} // namespace
 
 std::expected<App, std::string> App::create() {
 	auto gl_res = App::init_gl();
@@ -51,7 +71,7 @@ std::expected<App, std::string> App::create() {
 	return App(window, std::move(input_manager));
 };
 
-void App::run() {
+void App::run(bool light_benchmark) {
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 
@@ -64,6 +84,15 @@ void App::run() {
 	); // Second param install_callback=true will install GLFW callbacks and chain to existing ones.
 	ImGui_ImplOpenGL3_Init();
 
+	render_loop(light_benchmark);
+
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+	glfwTerminate();
+}
+
+void App::render_loop(bool light_benchmark) {
 	auto res = Shader::create("./shaders/vert.glsl", "./shaders/frag.glsl");
 	if (!res.has_value()) {
 		//cant print the std::string* directly lol
@@ -72,7 +101,9 @@ void App::run() {
 	}
 	auto shader = std::move(*res);
 
-	auto res_no_shade = Shader::create("./shaders/no_shade_v.glsl", "./shaders/no_shade_f.glsl");
+	// Light gizmos, one instanced draw for all of them
+	auto res_no_shade =
+	    Shader::create("./shaders/no_shade_v.glsl", "./shaders/no_shade_f.glsl", {"INSTANCED"});
 	if (!res_no_shade.has_value()) {
 		//cant print the std::string* directly lol
 		std::println("{}", res_no_shade.error().c_str());
@@ -80,38 +111,95 @@ void App::run() {
 	}
 	auto shader_no_shade = std::move(*res_no_shade);
 
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	double lastLoopTime = glfwGetTime();
+	auto res_indirect = Shader::create("./shaders/vert_indirect.glsl", "./shaders/frag.glsl");
+	if (!res_indirect.has_value()) {
+		std::println("{}", res_indirect.error().c_str());
+		return;
+	}
+	auto shader_indirect = std::move(*res_indirect);
 
-	auto cam = Camera(90.f);
-	input_manager.add_mouse_offset_callback([&cam](double x_offset, double y_offset) {
-		cam.updateLook(x_offset, y_offset);
-	});
+	auto res_clusters = ClusteredLights::create();
+	if (!res_clusters) {
+		std::println("{}", res_clusters.error());
+		return;
+	}
+	auto clusters = std::move(*res_clusters);
 
-	auto model_res = Model::create("./models/teapot.glb");
-	if (!model_res) {
-		std::println("{}", model_res.error().c_str());
+	auto res_deferred = DeferredRenderer::create();
+	if (!res_deferred) {
+		std::println("{}", res_deferred.error());
 		return;
 	}
-	auto model = std::move(*model_res);
+	auto deferred = std::move(*res_deferred);
+	auto light_path = LightPath::Forward;
 
-	auto cube_model_res = Model::create("./models/cube.glb");
-	if (!cube_model_res) {
-		std::println("{}", cube_model_res.error().c_str());
+	auto res_prepass = DepthPrepass::create();
+	if (!res_prepass) {
+		std::println("{}", res_prepass.error());
 		return;
 	}
-	auto cube_model = std::move(*cube_model_res);
+	auto depth_prepass = std::move(*res_prepass);
 
-	auto tenna_model_res = Model::create("./models/tenna_deltarune.glb");
-	if (!tenna_model_res) {
-		std::println("{}", tenna_model_res.error().c_str());
+	auto res_hi_z = HiZBuffer::create();
+	if (!res_hi_z) {
+		std::println("{}", res_hi_z.error());
 		return;
 	}
-	auto tenna_model = std::move(*tenna_model_res);
+	auto hi_z = std::move(*res_hi_z);
 
-	auto material_shininess = 32.f;
+	auto res_gpu_scene = GpuScene::create();
+	if (!res_gpu_scene) {
+		std::println("{}", res_gpu_scene.error());
+		return;
+	}
+	auto gpu_scene = std::move(*res_gpu_scene);
+	size_t gpu_instances = 0;
+
+	// Rebuilds both scene shaders for the material mode and light loop, keeping the old ones
+	// on failure
+	auto load_scene_shaders = [&]() {
+		auto mode = MaterialTable::shared().mode();
+		std::vector<std::string> defines;
+		if (mode != MaterialMode::PerDraw) defines.push_back("MATERIAL_TABLE");
+		if (mode == MaterialMode::Bindless) defines.push_back("MATERIAL_BINDLESS");
+		if (mode == MaterialMode::TextureArray) defines.push_back("MATERIAL_ARRAYS");
+		if (light_path == LightPath::Clustered) defines.push_back("CLUSTERED_LIGHTS");
+		if (light_path == LightPath::Deferred) defines.push_back("DEFERRED_GBUFFER");
+		auto direct = Shader::create("./shaders/vert.glsl", "./shaders/frag.glsl", defines);
+		auto indirect = Shader::create("./shaders/vert_indirect.glsl", "./shaders/frag.glsl", defines);
+		if (!direct || !indirect) {
+			std::println("{}", direct ? indirect.error() : direct.error());
+			return false;
+		}
+		shader = std::move(*direct);
+		shader_indirect = std::move(*indirect);
+		return true;
+	};
+	IndirectDraws indirect_draws;
+	RenderQueue render_queue;
+
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	double lastLoopTime = glfwGetTime();
 
-	std::vector<PointLight> point_lights = {PointLight {
+	auto cam = Camera(90.f);
+	input_manager.add_mouse_offset_callback([&cam](double x_offset, double y_offset) {
+		cam.updateLook(x_offset, y_offset);
+	});
+
+	// Loads run in the background, the frame loop draws placeholders until they are in
+	auto cube_model = ModelHandle::load("./models/cube.glb");
+	auto tenna_model =
+	    ModelHandle::load("./models/tenna_deltarune.glb", {.vertex_format = VertexFormat::Compact});
+
+	auto material_shininess = 32.f;
+	auto lod_threshold = 1.f;
+	auto cull_meshes = true;
+	auto cull_clusters = false;
+	auto use_indirect = true;
+	auto use_depth_prepass = false;
+	auto cull_occluded = false;
+
+	auto default_light = PointLight {
 	    .pos = glm::vec3(0.f, 10.f, 0.f),
 	    .ambient = glm::vec3(0.5f, 0.5f, 0.5f),
 	    .diffuse = glm::vec3(1.f, 1.f, 1.f),
@@ -119,13 +207,61 @@ void App::run() {
 	    .constant = 1.0f,
 	    .linear = 0.09f,
 	    .quadratic = 0.032f
-	}};
+	};
+	PointLightBuffer point_lights;
+	point_lights.add(default_light);
+	// Short range lights spread over a disc around the model, for scenes with many lights
+	auto spiral_light = [&](size_t n) {
+		auto light = default_light;
+		float radius = 1.5f * std::sqrt((float) n);
+		light.pos = glm::vec3(std::cos(n * 2.4f) * radius, 2.f, std::sin(n * 2.4f) * radius);
+		light.ambient = glm::vec3(0.f);
+		light.diffuse = light.specular = glm::vec3(0.5f);
+		light.linear = 0.7f;
+		light.quadratic = 1.8f;
+		return light;
+	};
+	// Light ranges, mirrored from point_lights every frame. Handle i is light i.
+	LooseOctree light_index(glm::vec3(0.f), 256.f);
+	std::vector<LooseOctree::Handle> light_handles;
+	std::vector<uint32_t> visible_lights;
+	InstanceBuffer gizmo_instances;
+	// Placement of the scene's models, their own node trees hang below these
+	TransformHierarchy scene_nodes;
+	auto tenna_node = scene_nodes.add(glm::mat4(1.f));
 	DirLight dir_light = {
 	    .direction = glm::vec3(-0.2f, -1.0f, -0.3f),
 	    .ambient = glm::vec3(0.05f, 0.05f, 0.05f),
 	    .diffuse = glm::vec3(0.04f, 0.0f, 0.4f),
 	};
 
+	// Scene GPU time from timestamps, read back a frame late
+	GLuint scene_queries[2][2];
+	glGenQueries(4, &scene_queries[0][0]);
+	double scene_gpu_ms = 0;
+	uint64_t frame = 0;
+
+	// `app bench lights`: scene GPU time by light count for each light path
+	struct LightBenchStep {
+		size_t lights;
+		LightPath path;
+		double gpu_ms = 0;
+		// Most light references a clustered step dropped in one frame
+		size_t dropped = 0;
+	};
+	std::vector<LightBenchStep> bench_steps;
+	if (light_benchmark) {
+		for (size_t lights: {1, 10, 100, 1000, 10000}) {
+			for (auto path: {LightPath::Forward, LightPath::Clustered, LightPath::Deferred}) {
+				bench_steps.push_back({lights, path});
+			}
+		}
+	}
+	size_t bench_step = 0;
+	int bench_frame = 0;
+	constexpr int bench_warmup = 30;
+	constexpr int bench_frames = 120;
+
 	while (!glfwWindowShouldClose(window)) {
 		double currentFrame = glfwGetTime();
 		double deltaTime = currentFrame - lastLoopTime;
@@ -144,34 +280,214 @@ void App::run() {
 		ImGui::Begin("Debug");
 		ImGui::Text("Debug Window");
 		ImGui::Text("FPS: %f", 1 / deltaTime);
+		for (const auto* handle: {&cube_model, &tenna_model}) {
+			if (handle->error()) {
+				ImGui::Text("Failed to load %s: %s", handle->path().c_str(), handle->error()->c_str());
+			} else if (!handle->ready()) {
+				ImGui::Text("Loading %s", handle->path().c_str());
+			}
+		}
+		auto texture_stats = TextureCache::shared().stats();
+		ImGui::Text(
+		    "Textures: %zu live, %zu hits, %zu misses, %.2f MB saved",
+		    texture_stats.live_textures,
+		    texture_stats.hits,
+		    texture_stats.misses,
+		    texture_stats.bytes_saved / (1024.0 * 1024.0)
+		);
+		for (auto format: {VertexFormat::Full, VertexFormat::Compact}) {
+			auto geometry = GeometryPool::shared(format).stats();
+			ImGui::Text(
+			    "Geometry %s: %zu meshes, %zu pages, %.2f/%.2f MB, %zu holes, %.0f%% fragmented",
+			    format == VertexFormat::Compact ? "compact" : "full",
+			    geometry.allocations,
+			    geometry.pages,
+			    (geometry.vertex_bytes_used + geometry.index_bytes_used) / (1024.0 * 1024.0),
+			    (geometry.vertex_bytes_capacity + geometry.index_bytes_capacity) / (1024.0 * 1024.0),
+			    geometry.free_blocks,
+			    geometry.fragmentation * 100.0
+			);
+		}
+		ImGui::DragFloat("LOD error (px)", &lod_threshold, 0.1f, 0.f, 64.f);
+		ImGui::Checkbox("Cull meshes", &cull_meshes);
+		// Cone culling drops back-facing clusters, wrong for the two-sided rendering used here
+		ImGui::Checkbox("Cull meshlets (debug)", &cull_clusters);
+		ImGui::Checkbox("Multi-draw indirect", &use_indirect);
+		ImGui::Checkbox("Depth pre-pass", &use_depth_prepass);
+		// The readback is from a frame that may be long gone by the time it is enabled again
+		if (ImGui::Checkbox("Occlusion culling (Hi-Z)", &cull_occluded) && !cull_occluded) {
+			hi_z.clear();
+		}
+		auto prepass_stats = depth_prepass.stats();
+		ImGui::Text(
+		    "Pre-pass %.3f ms, main pass %.3f ms GPU, %.2fx overdraw (%llu samples shaded)",
+		    prepass_stats.prepass_ms,
+		    prepass_stats.main_ms,
+		    prepass_stats.overdraw,
+		    (unsigned long long) prepass_stats.shaded_samples
+		);
+		auto& materials = MaterialTable::shared();
+		static constexpr const char* material_modes[] = {"Per draw", "Bindless", "Texture arrays"};
+		int material_mode = (int) materials.mode();
+		if (ImGui::Combo("Materials", &material_mode, material_modes, 3)) {
+			auto previous = materials.mode();
+			auto res = materials.set_mode((MaterialMode) material_mode);
+			if (!res) {
+				std::println("{}", res.error());
+			} else if (!load_scene_shaders()) {
+				(void) materials.set_mode(previous);
+			}
+		}
+		if (materials.active()) {
+			auto material_stats = materials.stats();
+			ImGui::Text(
+			    "Materials: %zu, %zu arrays / %zu layers (%.2f MB), %zu overflowing, %zu uploads",
+			    material_stats.materials,
+			    material_stats.arrays,
+			    material_stats.array_layers,
+			    material_stats.array_bytes / (1024.0 * 1024.0),
+			    material_stats.overflow,
+			    material_stats.uploads
+			);
+		}
+		auto queue_stats = render_queue.stats();
+		ImGui::Text(
+		    "Queue: %zu draws, %zu program / %zu material / %zu geometry changes, sort %.3f ms",
+		    queue_stats.draws,
+		    queue_stats.program_changes,
+		    queue_stats.material_changes,
+		    queue_stats.geometry_changes,
+		    queue_stats.sort_ms
+		);
+		if (use_indirect) {
+			auto indirect_stats = indirect_draws.stats();
+			ImGui::Text(
+			    "Indirect: %zu draws, %zu commands, %zu multi-draw calls, %zu in the pre-pass",
+			    indirect_stats.draws,
+			    indirect_stats.commands,
+			    indirect_stats.batches,
+			    indirect_stats.position_batches
+			);
+		}
+		if (auto model = tenna_model.get()) {
+			ImGui::Text(
+			    "Meshes: %zu tested, %zu visible, %zu culled",
+			    model->mesh_stats.tested,
+			    model->mesh_stats.visible,
+			    model->mesh_stats.culled
+			);
+			if (cull_occluded) {
+				ImGui::Text(
+				    "Occlusion: %zu tested, %zu draws / %zu triangles culled, pyramid %.3f ms",
+				    model->occlusion_stats.tested,
+				    model->occlusion_stats.culled,
+				    model->occlusion_stats.culled_triangles,
+				    hi_z.build_ms()
+				);
+			}
+			const auto& stats = model->cluster_stats;
+			ImGui::Text(
+			    "Meshlets: %zu tested, %zu off-screen, %zu backfacing",
+			    stats.tested,
+			    stats.frustum_culled,
+			    stats.backface_culled
+			);
+		}
+		ImGui::Text("GPU-driven instances (multi-draw indirect only)");
+		if (ImGui::Button("Add 10000 cubes") && cube_model.ready()) {
+			// A square field below the model, growing outwards in rings
+			for (int i = 0; i < 10000; i++, gpu_instances++) {
+				float radius = 3.f * std::sqrt((float) gpu_instances);
+				auto pos = glm::vec3(
+				    std::cos(gpu_instances * 2.4f) * radius,
+				    -4.f,
+				    std::sin(gpu_instances * 2.4f) * radius
+				);
+				cube_model.get()->add_instance(gpu_scene, glm::translate(glm::mat4(1.f), pos));
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear instances")) {
+			gpu_scene.clear();
+			gpu_instances = 0;
+		}
+		auto gpu_stats = gpu_scene.stats();
+		ImGui::Text(
+		    "%zu draws, %zu commands in %zu batches, %zu visible, cull %.3f ms (%s)",
+		    gpu_stats.draws,
+		    gpu_stats.commands,
+		    gpu_stats.batches,
+		    gpu_stats.visible,
+		    gpu_stats.cull_ms,
+		    gpu_stats.draw_count ? "draw count" : "zero instance fallback"
+		);
 		ImGui::Text("material");
 		ImGui::PushID("material");
 		ImGui::DragFloat("shininess", &material_shininess);
 		ImGui::PopID();
 		ImGui::Text("Light");
-		if (ImGui::Button("Add")) {
-			point_lights.push_back(PointLight {
-			    .pos = glm::vec3(0.f, 10.f, 0.f),
-			    .ambient = glm::vec3(0.5f, 0.5f, 0.5f),
-			    .diffuse = glm::vec3(1.f, 1.f, 1.f),
-			    .specular = glm::vec3(1.0f, 1.0f, 1.0f),
-			    .constant = 1.0f,
-			    .linear = 0.09f,
-			    .quadratic = 0.032f
-			});
+		if (ImGui::Button("Add")) point_lights.add(default_light);
+		ImGui::SameLine();
+		if (ImGui::Button("Add 100")) {
+			for (int i = 0; i < 100; i++) point_lights.add(spiral_light(point_lights.size()));
+		}
+		int path_index = (int) light_path;
+		if (ImGui::Combo("Light path", &path_index, light_path_names, 3)) {
+			auto previous = light_path;
+			light_path = (LightPath) path_index;
+			if (!load_scene_shaders()) light_path = previous;
 		}
-		for (size_t i = 0; i < point_lights.size(); ++i) {
-			auto& light = point_lights[i];
-			ImGui::PushID(std::format("light{}", i).c_str());
-			ImGui::DragFloat3("position", glm::value_ptr(light.pos));
-			ImGui::ColorEdit3("ambient", glm::value_ptr(light.ambient));
-			ImGui::ColorEdit3("specular", glm::value_ptr(light.specular));
-			ImGui::ColorEdit3("diffuse", glm::value_ptr(light.diffuse));
-			ImGui::DragFloat("constant", &light.constant);
-			ImGui::DragFloat("linear", &light.linear);
-			ImGui::DragFloat("quadratic", &light.quadratic);
+		auto light_stats = point_lights.stats();
+		ImGui::Text(
+		    "%zu lights, capacity %zu, %zu bytes uploaded, %zu reallocations",
+		    light_stats.lights,
+		    light_stats.capacity,
+		    light_stats.uploaded_bytes,
+		    light_stats.reallocations
+		);
+		auto index_stats = light_index.stats();
+		ImGui::Text(
+		    "Light index: %zu nodes, %zu in view",
+		    index_stats.nodes,
+		    visible_lights.size()
+		);
+		ImGui::Text(
+		    "Scene %.3f ms GPU, light assignment %.3f ms",
+		    scene_gpu_ms,
+		    light_path == LightPath::Clustered ? clusters.assign_ms() : 0.0
+		);
+		if (light_path == LightPath::Clustered) {
+			auto overflow = clusters.overflow();
+			ImGui::Text(
+			    "%zu lights dropped from %zu full clusters",
+			    overflow.lights,
+			    overflow.clusters
+			);
+		}
+		if (light_path == LightPath::Deferred) {
+			auto deferred_stats = deferred.stats();
+			ImGui::Text(
+			    "G-buffer %.2f MB, %zu light volumes",
+			    deferred_stats.gbuffer_bytes / (1024.0 * 1024.0),
+			    deferred_stats.light_volumes
+			);
+		}
+		// Editors for the first few only, scenes can have thousands
+		for (size_t i = 0; i < std::min<size_t>(point_lights.size(), 16); ++i) {
+			auto light = point_lights[i];
+			ImGui::PushID((int) i);
+			bool changed = ImGui::DragFloat3("position", glm::value_ptr(light.pos));
+			changed |= ImGui::ColorEdit3("ambient", glm::value_ptr(light.ambient));
+			changed |= ImGui::ColorEdit3("specular", glm::value_ptr(light.specular));
+			changed |= ImGui::ColorEdit3("diffuse", glm::value_ptr(light.diffuse));
+			changed |= ImGui::DragFloat("constant", &light.constant);
+			changed |= ImGui::DragFloat("linear", &light.linear);
+			changed |= ImGui::DragFloat("quadratic", &light.quadratic);
+			bool removed = ImGui::Button("Remove");
 			ImGui::Separator();
 			ImGui::PopID();
+			if (changed) point_lights.set(i, light);
+			if (removed) point_lights.remove(i--);
 		}
 		ImGui::End();
 
@@ -189,8 +505,60 @@ void App::run() {
 			}
 		}
 
+		if (frame > 0) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(scene_queries[(frame - 1) % 2][0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(scene_queries[(frame - 1) % 2][1], GL_QUERY_RESULT, &end);
+			scene_gpu_ms = (end - begin) / 1e6;
+		}
+		// The bench would wait for the model forever
+		if (bench_step < bench_steps.size() && tenna_model.error()) {
+			glfwSetWindowShouldClose(window, true);
+		}
+		if (bench_step < bench_steps.size() && tenna_model.ready()) {
+			auto& step = bench_steps[bench_step];
+			if (bench_frame == 0) {
+				point_lights.clear();
+				for (size_t i = 0; i < step.lights; i++) point_lights.add(spiral_light(i));
+				light_path = step.path;
+				load_scene_shaders();
+			} else if (bench_frame > bench_warmup) {
+				step.gpu_ms += scene_gpu_ms / bench_frames;
+				if (step.path == LightPath::Clustered) {
+					step.dropped = std::max(step.dropped, clusters.overflow().lights);
+				}
+			}
+			if (++bench_frame > bench_warmup + bench_frames) {
+				bench_frame = 0;
+				if (++bench_step == bench_steps.size()) {
+					// Clustered shades fewer lights than the others once it drops any
+					std::println(
+					    "{:>8}{:>14}{:>14}{:>14}{:>14}",
+					    "lights",
+					    "forward ms",
+					    "clustered ms",
+					    "deferred ms",
+					    "dropped"
+					);
+					for (size_t i = 0; i < bench_steps.size(); i += 3) {
+						std::println(
+						    "{:>8}{:>14.3f}{:>14.3f}{:>14.3f}{:>14}",
+						    bench_steps[i].lights,
+						    bench_steps[i].gpu_ms,
+						    bench_steps[i + 1].gpu_ms,
+						    bench_steps[i + 2].gpu_ms,
+						    bench_steps[i + 1].dropped
+						);
+					}
+					glfwSetWindowShouldClose(window, true);
+				}
+			}
+		}
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		shader.use();
+		glQueryCounter(scene_queries[frame % 2][0], GL_TIMESTAMP);
+		auto& scene_shader = use_indirect ? shader_indirect : shader;
+		scene_shader.use();
 
 		glm::mat4 view;
 		view = glm::lookAt(cam.pos, cam.pos + cam.front, cam.up);
@@ -199,49 +567,119 @@ void App::run() {
 		glfwGetWindowSize(window, &screen_width, &screen_height);
 		auto projection =
 		    glm::perspective(cam.fov, ((float) screen_width / (float) screen_height), 0.1f, 100.f);
-		glm::mat4 model_matrix = glm::mat4(1.0f);
-		model_matrix = glm::translate(model_matrix, glm::vec3(0.0f, 0.0f, 0.0f));
-		model_matrix = glm::rotate(
-		    model_matrix,
-		    (float) glm::radians(glfwGetTime() * 100.f),
-		    glm::vec3(0.0f, 1.0f, 0.0f)
+		scene_nodes.set_local(
+		    tenna_node,
+		    glm::rotate(
+		        glm::mat4(1.f),
+		        (float) glm::radians(glfwGetTime() * 100.f),
+		        glm::vec3(0.0f, 1.0f, 0.0f)
+		    )
 		);
-		shader.setMat4("projection", glm::value_ptr(projection));
-		shader.setMat4("view", glm::value_ptr(view));
-		shader.setMat4("model", glm::value_ptr(model_matrix));
-		shader.setMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(model_matrix))));
-		shader.setVec3("viewPos", cam.pos);
-		shader.setFloat("material.shininess", material_shininess);
-		dir_light.set_shader_data(shader);
-		shader.setInt("point_light_num", point_lights.size());
-		for (size_t i = 0; i < point_lights.size(); i++) {
-			point_lights[i].set_shader_data(i, shader);
+		scene_nodes.update();
+		const auto& model_matrix = scene_nodes.world(tenna_node);
+		scene_shader.setMat4("projection", glm::value_ptr(projection));
+		scene_shader.setMat4("view", glm::value_ptr(view));
+		scene_shader.setMat4("model", model_matrix);
+		scene_shader.setMat3("normalMatrix", scene_nodes.normal_matrix(tenna_node));
+		scene_shader.setVec3("view_pos", cam.pos);
+		scene_shader.setFloat("material.shininess", material_shininess);
+		dir_light.set_shader_data(scene_shader);
+		point_lights.upload(scene_shader);
+		int framebuffer_width, framebuffer_height;
+		glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+		if (light_path == LightPath::Deferred) {
+			deferred.begin_geometry(framebuffer_width, framebuffer_height);
 		}
-		tenna_model.draw(shader);
-
-		for (const auto& light: point_lights) {
-			auto light_model = glm::mat4(1.f);
-			light_model = glm::translate(light_model, light.pos);
-			shader_no_shade.use();
-			shader_no_shade.setMat4("projection", glm::value_ptr(projection));
-			shader_no_shade.setMat4("view", glm::value_ptr(view));
-			shader_no_shade.setMat4("model", light_model);
-			shader_no_shade.setVec3("lightColor", light.diffuse);
-			cube_model.draw(shader_no_shade);
+		if (light_path == LightPath::Clustered) {
+			clusters.assign(point_lights, view, projection, 0.1f, 100.f);
+			scene_shader.use();
+			clusters.bind(scene_shader, framebuffer_width, framebuffer_height);
 		}
+		if (cull_occluded) hi_z.poll();
+		auto tenna_view = DrawView {
+		    .model = model_matrix,
+		    .view_projection = projection * view,
+		    .camera_pos = cam.pos,
+		    .projection_scale = screen_height * projection[1][1] * 0.5f,
+		    .lod_threshold = lod_threshold,
+		    .cull_meshes = cull_meshes,
+		    .cull_clusters = cull_clusters,
+		    .occlusion = cull_occluded ? &hi_z : nullptr,
+		    .indirect = use_indirect ? &indirect_draws : nullptr,
+		};
+		render_queue.begin(cam.pos, cam.front, 100.f);
+		if (use_indirect) {
+			tenna_model.draw(scene_shader, tenna_view);
+		} else {
+			tenna_model.enqueue(render_queue, RenderQueue::Pass::Opaque, scene_shader, tenna_view);
+		}
+		// Instances are culled and their commands written without the CPU looking at them
+		if (use_indirect) gpu_scene.cull(projection * view, cull_occluded ? &hi_z : nullptr);
+		if (use_depth_prepass) {
+			auto& depth_shader = depth_prepass.begin(use_indirect, view, projection);
+			if (use_indirect) {
+				indirect_draws.submit_positions();
+				gpu_scene.draw_positions();
+			} else {
+				render_queue.execute_positions(depth_shader);
+			}
+			depth_prepass.end();
+		}
+		depth_prepass.begin_main(framebuffer_width, framebuffer_height);
+		if (use_indirect) {
+			scene_shader.use();
+			indirect_draws.submit(scene_shader);
+			indirect_draws.clear();
+			gpu_scene.draw(scene_shader);
+		}
+		render_queue.execute();
+		depth_prepass.end_main();
+		if (light_path == LightPath::Deferred) {
+			deferred.light(point_lights, dir_light, projection * view, cam.pos);
+		}
+		// Only the scene occludes, gizmos are tested against it but never hide anything
+		if (cull_occluded) hi_z.build(framebuffer_width, framebuffer_height, projection * view);
+
+		while (light_handles.size() > point_lights.size()) {
+			light_index.remove(light_handles.back());
+			light_handles.pop_back();
+		}
+		for (uint32_t i = 0; i < point_lights.size(); i++) {
+			const auto& light = point_lights[i];
+			if (i < light_handles.size()) {
+				light_index.move(light_handles[i], light.pos, light.range());
+			} else {
+				light_handles.push_back(light_index.insert(light.pos, light.range(), i));
+			}
+		}
+		visible_lights.clear();
+		// Thousands of gizmos would swamp what the benchmark measures
+		if (!light_benchmark) {
+			light_index.query(Frustum::from_matrix(projection * view), visible_lights);
+		}
+
+		gizmo_instances.clear();
+		for (auto index: visible_lights) {
+			const auto& light = point_lights[index];
+			gizmo_instances.add(glm::translate(glm::mat4(1.f), light.pos), light.diffuse);
+		}
+		shader_no_shade.use();
+		shader_no_shade.setMat4("projection", glm::value_ptr(projection));
+		shader_no_shade.setMat4("view", glm::value_ptr(view));
+		// Drawn after lighting, so gizmos stay out of the GL_EQUAL pass and the G-buffer
+		cube_model.draw_instanced(shader_no_shade, gizmo_instances);
+		glQueryCounter(scene_queries[frame % 2][1], GL_TIMESTAMP);
+		frame++;
 
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		GeometryPool::reset_binding();
+		MaterialTable::reset_binding();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
-	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
-	ImGui::DestroyContext();
-	shader.~Shader();
-
-	glfwTerminate();
+	glDeleteQueries(4, &scene_queries[0][0]);
 }
 
 App::App(GLFWwindow* window, InputManager input_manager)
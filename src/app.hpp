@@ -10,11 +10,14 @@ public:
 	static std::expected<App, std::string> create();
 	InputManager input_manager;
 	App(App&& other) noexcept;
-	void run();
+	// `light_benchmark` steps through light counts, prints frame GPU times and exits.
+	void run(bool light_benchmark = false);
 
 private:
 	static std::expected<GLFWwindow*, std::string> init_gl();
 	void glfw_error_callback(int error_code, const char* desc);
+	// Everything owning GL objects lives in here, so it is gone before the context is
+	void render_loop(bool light_benchmark);
 	GLFWwindow* window;
 
 	App(GLFWwindow* window, InputManager input_manager);
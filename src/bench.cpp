@@ -0,0 +1,448 @@
+#include "bench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <glm/common.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/trigonometric.hpp>
+#include <print>
+#include <string>
+#include <string_view>
+#include <random>
+#include <thread>
+#include <vector>
+#include "app.hpp"
+#include "culling.hpp"
+#include "loose_octree.hpp"
+#include "meshlet.hpp"
+#include "model.hpp"
+#include "thread_pool.hpp"
+#include "transform_hierarchy.hpp"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Positional arguments, or every `ext` file in `dir` when none are given.
+std::vector<std::string>
+paths_or_default(std::span<char*> args, const char* dir, std::string_view ext) {
+	std::vector<std::string> paths(args.begin(), args.end());
+	if (!paths.empty()) return paths;
+	for (const auto& entry: std::filesystem::directory_iterator(dir)) {
+		if (entry.path().extension() == ext) paths.push_back(entry.path().string());
+	}
+	std::ranges::sort(paths);
+	return paths;
+}
+
+// Model::import (Assimp + texture decode) per model, by worker thread count.
+int bench_import(std::span<char*> args) {
+	auto paths = paths_or_default(args, "./models", ".glb");
+	size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<size_t> thread_counts;
+	for (size_t n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	std::print("{:<32}", "model");
+	for (auto n: thread_counts) std::print("{:>10}", std::format("{}T ms", n));
+	std::println("");
+
+	for (const auto& path: paths) {
+		std::print("{:<32}", path);
+		for (auto n: thread_counts) {
+			ThreadPool pool(n);
+			double best = 1e30;
+			for (int run = 0; run < 3; run++) {
+				auto start = Clock::now();
+				auto data = Model::import(path, ModelOptions {}, pool);
+				if (!data) {
+					std::println("\n{}", data.error());
+					return 1;
+				}
+				best = std::min(best, elapsed_ms(start));
+			}
+			std::print("{:>10.2f}", best);
+		}
+		std::println("");
+	}
+	return 0;
+}
+
+// cull_meshlets over every meshlet of each model, from cameras orbiting it.
+int bench_cluster_cull(std::span<char*> args) {
+	auto paths = paths_or_default(args, "./models", ".glb");
+	constexpr size_t views = 1000;
+
+	std::println(
+	    "{:<32}{:>10}{:>12}{:>12}{:>12}{:>12}",
+	    "model",
+	    "meshlets",
+	    "ns/meshlet",
+	    "off-screen",
+	    "backfacing",
+	    "visible"
+	);
+	for (const auto& path: paths) {
+		auto options = ModelOptions {.compress_textures = false};
+		auto data = Model::import(path, options, ThreadPool::shared());
+		if (!data) {
+			std::println("{}", data.error());
+			return 1;
+		}
+
+		std::vector<Meshlet> meshlets;
+		for (const auto& mesh: data->meshes) {
+			meshlets.insert(meshlets.end(), mesh.meshlets.begin(), mesh.meshlets.end());
+		}
+		if (meshlets.empty()) continue;
+		glm::vec3 lo = meshlets[0].center, hi = lo;
+		for (const auto& meshlet: meshlets) {
+			lo = glm::min(lo, meshlet.center - glm::vec3(meshlet.radius));
+			hi = glm::max(hi, meshlet.center + glm::vec3(meshlet.radius));
+		}
+		auto center = (lo + hi) * 0.5f;
+		float radius = glm::length(hi - lo) * 0.5f;
+
+		// Cameras on a sphere at twice the model radius, looking roughly at the center
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+		std::vector<ClusterCullView> cull_views;
+		auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, radius * 10.f);
+		for (size_t i = 0; i < views; i++) {
+			glm::vec3 dir(unit(rng), unit(rng), unit(rng));
+			if (glm::length(dir) < 1e-3f) dir = glm::vec3(0.f, 0.f, 1.f);
+			auto eye = center + glm::normalize(dir) * radius * 2.f;
+			auto target = center + glm::vec3(unit(rng), unit(rng), unit(rng)) * radius;
+			auto view = glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f));
+			cull_views.push_back(ClusterCullView::create(projection * view, eye));
+		}
+
+		ClusterCullStats stats;
+		std::vector<uint32_t> visible;
+		size_t visible_total = 0;
+		auto start = Clock::now();
+		for (const auto& cull_view: cull_views) {
+			visible.clear();
+			cull_meshlets(meshlets, cull_view, visible, stats);
+			visible_total += visible.size();
+		}
+		double ms = elapsed_ms(start);
+
+		auto percent = [&](size_t n) { return std::format("{:.1f}%", 100.0 * n / stats.tested); };
+		std::println(
+		    "{:<32}{:>10}{:>12.2f}{:>12}{:>12}{:>12}",
+		    path,
+		    meshlets.size(),
+		    ms * 1e6 / stats.tested,
+		    percent(stats.frustum_culled),
+		    percent(stats.backface_culled),
+		    percent(visible_total)
+		);
+	}
+	return 0;
+}
+
+// cull_boxes over 1M random boxes against the straightforward per-box loop, from cameras
+// spread through the field.
+int bench_frustum_cull(std::span<char*> args) {
+	constexpr size_t box_count = 1'000'000;
+	constexpr size_t views = 64;
+	constexpr float field = 1000.f;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-field * 0.5f, field * 0.5f);
+	std::uniform_real_distribution<float> size(0.5f, 5.f);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::vector<Bounds> bounds(box_count);
+	BoxBatch boxes;
+	for (auto& box: bounds) {
+		box.min = glm::vec3(position(rng), position(rng), position(rng));
+		box.max = box.min + glm::vec3(size(rng), size(rng), size(rng));
+		boxes.add(box.min, box.max);
+	}
+
+	std::vector<Frustum> frustums;
+	auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, field * 0.5f);
+	for (size_t i = 0; i < views; i++) {
+		auto eye = glm::vec3(position(rng), position(rng), position(rng));
+		glm::vec3 dir(unit(rng), unit(rng), unit(rng));
+		if (glm::length(dir) < 1e-3f) dir = glm::vec3(0.f, 0.f, 1.f);
+		auto view = glm::lookAt(eye, eye + dir, glm::vec3(0.f, 1.f, 0.f));
+		frustums.push_back(Frustum::from_matrix(projection * view));
+	}
+
+	// Array of boxes, plane loop with an early out, as culling usually starts out
+	std::vector<uint32_t> visible;
+	visible.reserve(box_count);
+	size_t scalar_visible = 0;
+	auto start = Clock::now();
+	for (const auto& frustum: frustums) {
+		visible.clear();
+		for (uint32_t i = 0; i < box_count; i++) {
+			auto center = (bounds[i].min + bounds[i].max) * 0.5f;
+			auto extent = (bounds[i].max - bounds[i].min) * 0.5f;
+			bool inside = true;
+			for (const auto& plane: frustum.planes) {
+				float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+				if (distance + glm::dot(glm::abs(glm::vec3(plane)), extent) < 0.f) {
+					inside = false;
+					break;
+				}
+			}
+			if (inside) visible.push_back(i);
+		}
+		scalar_visible += visible.size();
+	}
+	double scalar_ms = elapsed_ms(start) / views;
+
+	CullStats stats;
+	start = Clock::now();
+	for (const auto& frustum: frustums) {
+		visible.clear();
+		cull_boxes(frustum, boxes, visible, stats);
+	}
+	double batch_ms = elapsed_ms(start) / views;
+
+	std::println("{:<16}{:>12}{:>12}{:>12}", "", "ms/view", "ns/box", "visible");
+	auto row = [&](const char* name, double ms, size_t visible_total) {
+		std::println(
+		    "{:<16}{:>12.3f}{:>12.3f}{:>12}",
+		    name,
+		    ms,
+		    ms * 1e6 / box_count,
+		    std::format("{:.2f}%", 100.0 * visible_total / (box_count * views))
+		);
+	};
+	row("per box", scalar_ms, scalar_visible);
+	row("SoA batches", batch_ms, stats.visible);
+	return 0;
+}
+
+// LooseOctree with 100k objects moving every frame: keeping it up to date, incrementally or
+// by rebuilding, against frustum and light range queries, with linear scans for reference.
+int bench_spatial_index(std::span<char*> args) {
+	constexpr size_t object_count = 100'000;
+	constexpr size_t frames = 30;
+	constexpr size_t frustum_queries = 16;
+	constexpr size_t sphere_queries = 1000;
+	constexpr float field = 500.f; // half size
+	constexpr float light_range = 10.f;
+
+	struct Object {
+		glm::vec3 pos;
+		glm::vec3 velocity;
+		float radius;
+		LooseOctree::Handle handle;
+	};
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-field, field);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::uniform_real_distribution<float> size(0.5f, 2.f);
+	LooseOctree index(glm::vec3(0.f), field);
+	std::vector<Object> objects(object_count);
+	for (uint32_t i = 0; i < object_count; i++) {
+		auto& object = objects[i];
+		object.pos = glm::vec3(position(rng), position(rng), position(rng));
+		object.velocity = glm::vec3(unit(rng), unit(rng), unit(rng)) * 2.f;
+		object.radius = size(rng);
+		object.handle = index.insert(object.pos, object.radius, i);
+	}
+	auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, field);
+
+	double move_ms = 0, rebuild_ms = 0;
+	double frustum_ms = 0, frustum_linear_ms = 0, sphere_ms = 0, sphere_linear_ms = 0;
+	size_t frustum_hits = 0, frustum_linear_hits = 0, sphere_hits = 0, sphere_linear_hits = 0;
+	std::vector<uint32_t> found;
+	LooseOctree rebuilt(glm::vec3(0.f), field);
+	for (size_t frame = 0; frame < frames; frame++) {
+		for (auto& object: objects) {
+			object.pos += object.velocity;
+			for (int c = 0; c < 3; c++) {
+				if (std::abs(object.pos[c]) > field) object.velocity[c] = -object.velocity[c];
+			}
+		}
+
+		auto start = Clock::now();
+		for (const auto& object: objects) index.move(object.handle, object.pos, object.radius);
+		move_ms += elapsed_ms(start);
+
+		start = Clock::now();
+		rebuilt.clear();
+		for (uint32_t i = 0; i < object_count; i++) {
+			rebuilt.insert(objects[i].pos, objects[i].radius, i);
+		}
+		rebuild_ms += elapsed_ms(start);
+
+		std::vector<Frustum> frustums;
+		for (size_t i = 0; i < frustum_queries; i++) {
+			auto eye = glm::vec3(position(rng), position(rng), position(rng));
+			glm::vec3 dir(unit(rng), unit(rng), unit(rng));
+			if (glm::length(dir) < 1e-3f) dir = glm::vec3(0.f, 0.f, 1.f);
+			auto view = glm::lookAt(eye, eye + dir, glm::vec3(0.f, 1.f, 0.f));
+			frustums.push_back(Frustum::from_matrix(projection * view));
+		}
+		start = Clock::now();
+		for (const auto& frustum: frustums) {
+			found.clear();
+			index.query(frustum, found);
+			frustum_hits += found.size();
+		}
+		frustum_ms += elapsed_ms(start);
+		start = Clock::now();
+		for (const auto& frustum: frustums) {
+			for (const auto& object: objects) {
+				bool inside = true;
+				for (const auto& plane: frustum.planes) {
+					inside &= glm::dot(glm::vec3(plane), object.pos) + plane.w >= -object.radius;
+				}
+				frustum_linear_hits += inside;
+			}
+		}
+		frustum_linear_ms += elapsed_ms(start);
+
+		std::vector<glm::vec3> lights;
+		for (size_t i = 0; i < sphere_queries; i++) {
+			lights.push_back(glm::vec3(position(rng), position(rng), position(rng)));
+		}
+		start = Clock::now();
+		for (auto light: lights) {
+			found.clear();
+			index.query(light, light_range, found);
+			sphere_hits += found.size();
+		}
+		sphere_ms += elapsed_ms(start);
+		start = Clock::now();
+		for (auto light: lights) {
+			for (const auto& object: objects) {
+				auto offset = object.pos - light;
+				float reach = object.radius + light_range;
+				sphere_linear_hits += glm::dot(offset, offset) <= reach * reach;
+			}
+		}
+		sphere_linear_ms += elapsed_ms(start);
+	}
+
+	auto stats = index.stats();
+	std::println(
+	    "{} objects, {} nodes, {} kept in the root",
+	    stats.objects,
+	    stats.nodes,
+	    stats.root_objects
+	);
+	std::println("{:<28}{:>12}{:>12}{:>14}", "per frame", "octree ms", "linear ms", "hits");
+	std::println("{:<28}{:>12.3f}", "move all objects", move_ms / frames);
+	std::println("{:<28}{:>12.3f}", "rebuild from scratch", rebuild_ms / frames);
+	std::println(
+	    "{:<28}{:>12.3f}{:>12.3f}{:>14}",
+	    std::format("{} frustum queries", frustum_queries),
+	    frustum_ms / frames,
+	    frustum_linear_ms / frames,
+	    std::format("{}/{}", frustum_hits / frames, frustum_linear_hits / frames)
+	);
+	std::println(
+	    "{:<28}{:>12.3f}{:>12.3f}{:>14}",
+	    std::format("{} light range queries", sphere_queries),
+	    sphere_ms / frames,
+	    sphere_linear_ms / frames,
+	    std::format("{}/{}", sphere_hits / frames, sphere_linear_hits / frames)
+	);
+	return 0;
+}
+
+// TransformHierarchy with 1M nodes in 8-ary trees and 1% of the locals changing each frame:
+// the dirty-flag update against recomputing every world and normal matrix.
+int bench_transforms(std::span<char*> args) {
+	constexpr size_t node_count = 1'000'000;
+	constexpr size_t frames = 30;
+	constexpr size_t changed = node_count / 100;
+	constexpr size_t roots = 64;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::uniform_int_distribution<uint32_t> pick(0, node_count - 1);
+	auto random_local = [&] {
+		auto local = glm::translate(glm::mat4(1.f), glm::vec3(unit(rng), unit(rng), unit(rng)));
+		return glm::rotate(local, unit(rng) * 3.14f, glm::vec3(0.f, 1.f, 0.f));
+	};
+	TransformHierarchy nodes;
+	for (uint32_t i = 0; i < node_count; i++) {
+		auto parent = i < roots ? TransformHierarchy::no_parent : (uint32_t) (i - roots) / 8;
+		nodes.add(random_local(), parent);
+	}
+	nodes.update();
+
+	std::vector<glm::mat4> worlds(node_count);
+	std::vector<glm::mat3> normals(node_count);
+	double update_ms = 0, full_ms = 0;
+	size_t updated = 0;
+	for (size_t frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < changed; i++) {
+			auto node = pick(rng);
+			nodes.set_local(node, random_local());
+		}
+
+		auto start = Clock::now();
+		updated += nodes.update();
+		update_ms += elapsed_ms(start);
+
+		start = Clock::now();
+		for (uint32_t i = 0; i < node_count; i++) {
+			auto parent = nodes.parent(i);
+			worlds[i] = parent == TransformHierarchy::no_parent
+			              ? nodes.local(i)
+			              : worlds[parent] * nodes.local(i);
+			normals[i] = glm::transpose(glm::inverse(glm::mat3(worlds[i])));
+		}
+		full_ms += elapsed_ms(start);
+	}
+
+	std::println("{} nodes, {} locals changed per frame", node_count, changed);
+	std::println("{:<28}{:>12}{:>14}", "per frame", "ms", "recomputed");
+	std::println("{:<28}{:>12.3f}{:>14}", "dirty subtrees", update_ms / frames, updated / frames);
+	std::println("{:<28}{:>12.3f}{:>14}", "every node", full_ms / frames, node_count);
+	return 0;
+}
+
+// Scene GPU time with 1 to 10k point lights, forward, clustered and deferred. Needs a window.
+int bench_lights(std::span<char*> args) {
+	auto app = App::create();
+	if (!app) {
+		std::println("{}", app.error());
+		return 1;
+	}
+	app->run(true);
+	return 0;
+}
+
+struct Benchmark {
+	const char* name;
+	std::function<int(std::span<char*>)> run;
+};
+
+const std::vector<Benchmark> benchmarks = {
+    {"import", bench_import},
+    {"cluster-cull", bench_cluster_cull},
+    {"frustum-cull", bench_frustum_cull},
+    {"spatial-index", bench_spatial_index},
+    {"transforms", bench_transforms},
+    {"lights", bench_lights},
+};
+} // namespace
+
+int run_benchmark(std::span<char*> args) {
+	if (!args.empty()) {
+		for (const auto& bench: benchmarks) {
+			if (args[0] == std::string_view(bench.name)) return bench.run(args.subspan(1));
+		}
+	}
+	std::println("usage: app bench <name> [args...]");
+	for (const auto& bench: benchmarks) std::println("  {}", bench.name);
+	return 1;
+}
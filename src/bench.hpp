@@ -0,0 +1,5 @@
+#pragma once
+#include <span>
+
+// Headless benchmarks, run as `app bench <name> [args...]`.
+int run_benchmark(std::span<char*> args);
@@ -0,0 +1,125 @@
+#include "clustered_lights.hpp"
+#include <utility>
+#include <glm/ext/vector_float2.hpp>
+#include <glm/ext/vector_uint3.hpp>
+#include <glm/matrix.hpp>
+#include "point_light.hpp"
+
+std::expected<ClusteredLights, std::string> ClusteredLights::create() {
+	auto shader = Shader::create_compute("./shaders/cluster_lights.comp");
+	if (!shader) return std::unexpected(shader.error());
+	return ClusteredLights(std::move(*shader));
+}
+
+ClusteredLights::ClusteredLights(Shader shader): shader(std::move(shader)) {
+	GLuint buffers[3];
+	glGenBuffers(3, buffers);
+	buffer = buffers[0];
+	overflow_buffer = buffers[1];
+	readback_buffer = buffers[2];
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    cluster_count * cluster_stride * sizeof(uint32_t),
+	    nullptr,
+	    GL_DYNAMIC_COPY
+	);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, overflow_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, readback_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(uint32_t), nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glGenQueries(1, &query);
+}
+
+ClusteredLights::ClusteredLights(ClusteredLights&& other) noexcept
+    : shader(std::move(other.shader))
+    , buffer(std::exchange(other.buffer, 0))
+    , overflow_buffer(std::exchange(other.overflow_buffer, 0))
+    , readback_buffer(std::exchange(other.readback_buffer, 0))
+    , readback_fence(std::exchange(other.readback_fence, nullptr))
+    , last_overflow(other.last_overflow)
+    , query(std::exchange(other.query, 0))
+    , query_pending(other.query_pending)
+    , last_assign_ms(other.last_assign_ms)
+    , near_plane(other.near_plane)
+    , far_plane(other.far_plane) {}
+
+ClusteredLights::~ClusteredLights() noexcept {
+	GLuint buffers[] = {buffer, overflow_buffer, readback_buffer};
+	glDeleteBuffers(3, buffers);
+	if (readback_fence) glDeleteSync(readback_fence);
+	glDeleteQueries(1, &query);
+}
+
+void ClusteredLights::read_overflow() {
+	if (!readback_fence) return;
+	auto status = glClientWaitSync(readback_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	glDeleteSync(readback_fence);
+	readback_fence = nullptr;
+	uint32_t counts[2] = {};
+	glBindBuffer(GL_COPY_READ_BUFFER, readback_buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	last_overflow = Overflow {.clusters = counts[1], .lights = counts[0]};
+}
+
+void ClusteredLights::assign(
+    const PointLightBuffer& lights,
+    const glm::mat4& view,
+    const glm::mat4& projection,
+    float near_plane,
+    float far_plane
+) {
+	this->near_plane = near_plane;
+	this->far_plane = far_plane;
+	if (query_pending) {
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			last_assign_ms = ns / 1e6;
+			query_pending = false;
+		}
+	}
+	if (!query_pending) glBeginQuery(GL_TIME_ELAPSED, query);
+	read_overflow();
+
+	glClearNamedBufferData(overflow_buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	shader.use();
+	shader.setMat4("view", view);
+	shader.setMat4("inverse_projection", glm::inverse(projection));
+	shader.set(shader.uniform<glm::uvec3>("cluster_grid"), glm::uvec3(grid_x, grid_y, grid_z));
+	shader.setUint("cluster_stride", cluster_stride);
+	shader.setFloat("cluster_near", near_plane);
+	shader.setFloat("cluster_far", far_plane);
+	shader.setInt("point_light_num", lights.size());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer_binding, buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, overflow_binding, overflow_buffer);
+	glDispatchCompute((cluster_count + 63) / 64, 1, 1);
+	// The fragment shader reads the lists as a storage buffer, the counts are copied
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	if (!readback_fence) {
+		glCopyNamedBufferSubData(overflow_buffer, readback_buffer, 0, 0, 2 * sizeof(uint32_t));
+		readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	if (!query_pending) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_pending = true;
+	}
+}
+
+void ClusteredLights::bind(const Shader& shader, int width, int height) const {
+	shader.set(shader.uniform<glm::uvec3>("cluster_grid"), glm::uvec3(grid_x, grid_y, grid_z));
+	shader.setUint("cluster_stride", cluster_stride);
+	shader.setFloat("cluster_near", near_plane);
+	shader.setFloat("cluster_far", far_plane);
+	shader.set(
+	    shader.uniform<glm::vec2>("screen_size"),
+	    glm::vec2(width, height)
+	);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer_binding, buffer);
+}
@@ -0,0 +1,126 @@
+#include "culling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+Bounds Bounds::from_vertices(std::span<const Vertex> vertices) {
+	Bounds bounds {.min = glm::vec3(0.f), .max = glm::vec3(0.f)};
+	if (!vertices.empty()) bounds.min = bounds.max = vertices[0].pos;
+	for (const auto& vert: vertices) {
+		bounds.min = glm::min(bounds.min, vert.pos);
+		bounds.max = glm::max(bounds.max, vert.pos);
+	}
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	float radius_sq = 0.f;
+	for (const auto& vert: vertices) {
+		auto offset = vert.pos - bounds.center;
+		radius_sq = std::max(radius_sq, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radius_sq);
+	return bounds;
+}
+
+Bounds Bounds::transformed(const glm::mat4& matrix) const {
+	auto box_center = glm::vec3(matrix * glm::vec4((min + max) * 0.5f, 1.f));
+	auto half = (max - min) * 0.5f;
+	glm::vec3 extent(0.f);
+	for (int c = 0; c < 3; c++) extent += glm::abs(glm::vec3(matrix[c])) * half[c];
+	float scale = std::max(
+	    {glm::length(glm::vec3(matrix[0])),
+	     glm::length(glm::vec3(matrix[1])),
+	     glm::length(glm::vec3(matrix[2]))}
+	);
+	return Bounds {
+	    .min = box_center - extent,
+	    .max = box_center + extent,
+	    .center = glm::vec3(matrix * glm::vec4(center, 1.f)),
+	    .radius = radius * scale,
+	};
+}
+
+Frustum Frustum::from_matrix(const glm::mat4& view_projection) {
+	// The planes are the last row of the matrix plus or minus one of the others
+	const auto& m = view_projection;
+	auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+	Frustum frustum {
+	    .planes =
+	        {row(3) + row(0),
+	         row(3) - row(0),
+	         row(3) + row(1),
+	         row(3) - row(1),
+	         row(3) + row(2),
+	         row(3) - row(2)},
+	};
+	for (auto& plane: frustum.planes) plane = plane / glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+void BoxBatch::add(glm::vec3 min, glm::vec3 max) {
+	auto center = (min + max) * 0.5f;
+	auto extent = (max - min) * 0.5f;
+	center_x.push_back(center.x);
+	center_y.push_back(center.y);
+	center_z.push_back(center.z);
+	extent_x.push_back(extent.x);
+	extent_y.push_back(extent.y);
+	extent_z.push_back(extent.z);
+}
+
+void BoxBatch::clear() {
+	for (auto* values: {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z}) {
+		values->clear();
+	}
+}
+
+void cull_boxes(
+    const Frustum& frustum,
+    const BoxBatch& boxes,
+    std::vector<uint32_t>& visible,
+    CullStats& stats
+) {
+	// Plane components splatted once, the box loop below has no branches or gathers
+	float nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++) {
+		const auto& plane = frustum.planes[p];
+		nx[p] = plane.x;
+		ny[p] = plane.y;
+		nz[p] = plane.z;
+		nw[p] = plane.w;
+		ax[p] = std::abs(plane.x);
+		ay[p] = std::abs(plane.y);
+		az[p] = std::abs(plane.z);
+	}
+
+	// Masks for a block at a time, then a scalar pass appends the survivors
+	constexpr size_t block = 256;
+	uint8_t inside[block];
+	size_t count = boxes.size();
+	size_t visible_before = visible.size();
+	for (size_t first = 0; first < count; first += block) {
+		size_t n = std::min(block, count - first);
+		const float* cx = boxes.center_x.data() + first;
+		const float* cy = boxes.center_y.data() + first;
+		const float* cz = boxes.center_z.data() + first;
+		const float* ex = boxes.extent_x.data() + first;
+		const float* ey = boxes.extent_y.data() + first;
+		const float* ez = boxes.extent_z.data() + first;
+		for (size_t i = 0; i < n; i++) {
+			// Outside once the center is further behind a plane than the box reaches towards it
+			uint8_t in = 1;
+			for (int p = 0; p < 6; p++) {
+				float distance = nx[p] * cx[i] + ny[p] * cy[i] + nz[p] * cz[i] + nw[p];
+				float reach = ax[p] * ex[i] + ay[p] * ey[i] + az[p] * ez[i];
+				in &= (uint8_t) (distance + reach >= 0.f);
+			}
+			inside[i] = in;
+		}
+		for (size_t i = 0; i < n; i++) {
+			if (inside[i]) visible.push_back((uint32_t) (first + i));
+		}
+	}
+	size_t found = visible.size() - visible_before;
+	stats.tested += count;
+	stats.visible += found;
+	stats.culled += count - found;
+}
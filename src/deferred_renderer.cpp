@@ -0,0 +1,181 @@
+#include "deferred_renderer.hpp"
+#include <cstdint>
+#include <utility>
+#include <glm/ext/vector_float2.hpp>
+#include <glm/matrix.hpp>
+#include "dir_light.hpp"
+#include "geometry_pool.hpp"
+#include "point_light.hpp"
+
+namespace {
+// Unit cube around the origin, enclosing a light's range sphere once scaled by it
+constexpr float cube_vertices[] = {
+    -1, -1, -1, 1, -1, -1, 1, 1, -1, -1, 1, -1, -1, -1, 1, 1, -1, 1, 1, 1, 1, -1, 1, 1,
+};
+constexpr uint8_t cube_indices[] = {
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+};
+// Keeps volumes of lights that never fall off finite
+constexpr float max_light_range = 1000.f;
+
+GLuint create_target(GLenum internal_format, int width, int height) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return texture;
+}
+} // namespace
+
+std::expected<DeferredRenderer, std::string> DeferredRenderer::create() {
+	auto dir_shader = Shader::create("./shaders/deferred_v.glsl", "./shaders/deferred_dir_f.glsl");
+	if (!dir_shader) return std::unexpected(dir_shader.error());
+	auto light_shader =
+	    Shader::create("./shaders/deferred_light_v.glsl", "./shaders/deferred_light_f.glsl");
+	if (!light_shader) return std::unexpected(light_shader.error());
+	return DeferredRenderer(std::move(*dir_shader), std::move(*light_shader));
+}
+
+DeferredRenderer::DeferredRenderer(Shader dir_shader, Shader light_shader)
+    : dir_shader(std::move(dir_shader))
+    , light_shader(std::move(light_shader)) {
+	glGenVertexArrays(1, &volume_vao);
+	glGenBuffers(1, &volume_vbo);
+	glGenBuffers(1, &volume_ebo);
+	glBindVertexArray(volume_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, volume_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volume_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*) 0);
+	// The full screen pass makes its triangle from gl_VertexID, core GL still wants a VAO
+	glGenVertexArrays(1, &empty_vao);
+	glBindVertexArray(0);
+}
+
+DeferredRenderer::DeferredRenderer(DeferredRenderer&& other) noexcept
+    : dir_shader(std::move(other.dir_shader))
+    , light_shader(std::move(other.light_shader))
+    , framebuffer(std::exchange(other.framebuffer, 0))
+    , albedo(std::exchange(other.albedo, 0))
+    , normal(std::exchange(other.normal, 0))
+    , depth(std::exchange(other.depth, 0))
+    , volume_vao(std::exchange(other.volume_vao, 0))
+    , volume_vbo(std::exchange(other.volume_vbo, 0))
+    , volume_ebo(std::exchange(other.volume_ebo, 0))
+    , empty_vao(std::exchange(other.empty_vao, 0))
+    , width(other.width)
+    , height(other.height)
+    , last_stats(other.last_stats) {}
+
+DeferredRenderer::~DeferredRenderer() noexcept {
+	release_targets();
+	glDeleteVertexArrays(1, &volume_vao);
+	glDeleteVertexArrays(1, &empty_vao);
+	glDeleteBuffers(1, &volume_vbo);
+	glDeleteBuffers(1, &volume_ebo);
+}
+
+void DeferredRenderer::release_targets() {
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint textures[] = {albedo, normal, depth};
+	glDeleteTextures(3, textures);
+	framebuffer = albedo = normal = depth = 0;
+}
+
+void DeferredRenderer::begin_geometry(int width, int height) {
+	if (width != this->width || height != this->height || !framebuffer) {
+		release_targets();
+		this->width = width;
+		this->height = height;
+		albedo = create_target(GL_RGBA8, width, height);
+		normal = create_target(GL_RGBA16F, width, height);
+		depth = create_target(GL_DEPTH24_STENCIL8, width, height);
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+		glFramebufferTexture2D(
+		    GL_FRAMEBUFFER,
+		    GL_DEPTH_STENCIL_ATTACHMENT,
+		    GL_TEXTURE_2D,
+		    depth,
+		    0
+		);
+		static constexpr GLenum attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+		glDrawBuffers(2, attachments);
+		last_stats.gbuffer_bytes = (size_t) width * height * (4 + 8 + 4);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::light(
+    const PointLightBuffer& lights,
+    const DirLight& dir_light,
+    const glm::mat4& view_projection,
+    glm::vec3 camera_pos
+) {
+	// Forward passes after this one depth test against the scene
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GLuint targets[] = {albedo, normal, depth};
+	for (GLuint unit = 0; unit < 3; unit++) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, targets[unit]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	auto inverse_view_projection = glm::inverse(view_projection);
+	auto screen_size = glm::vec2(width, height);
+
+	glDepthMask(GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	dir_shader.use();
+	dir_shader.setMat4("inverse_view_projection", inverse_view_projection);
+	dir_shader.set(dir_shader.uniform<glm::vec2>("screen_size"), screen_size);
+	dir_shader.setVec3("view_pos", camera_pos);
+	dir_light.set_shader_data(dir_shader);
+	glBindVertexArray(empty_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Back faces behind the surface: the pixel lies in front of the volume's far side. Depth
+	// clamping keeps volumes reaching past the far plane whole.
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_GEQUAL);
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	light_shader.use();
+	light_shader.setMat4("view_projection", view_projection);
+	light_shader.setMat4("inverse_view_projection", inverse_view_projection);
+	light_shader.set(light_shader.uniform<glm::vec2>("screen_size"), screen_size);
+	light_shader.setVec3("view_pos", camera_pos);
+	light_shader.setFloat("max_range", max_light_range);
+	glBindVertexArray(volume_vao);
+	glDrawElementsInstanced(
+	    GL_TRIANGLES,
+	    sizeof(cube_indices),
+	    GL_UNSIGNED_BYTE,
+	    nullptr,
+	    lights.size()
+	);
+	last_stats.light_volumes = lights.size();
+
+	glBindVertexArray(0);
+	GeometryPool::reset_binding();
+	glDisable(GL_BLEND);
+	glCullFace(GL_BACK);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_CLAMP);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+}
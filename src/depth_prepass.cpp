@@ -0,0 +1,93 @@
+#include "depth_prepass.hpp"
+#include <algorithm>
+#include <utility>
+
+std::expected<DepthPrepass, std::string> DepthPrepass::create() {
+	auto direct = Shader::create("./shaders/depth_v.glsl", "./shaders/depth_f.glsl");
+	if (!direct) return std::unexpected(direct.error());
+	auto indirect =
+	    Shader::create("./shaders/depth_v.glsl", "./shaders/depth_f.glsl", {"INDIRECT_DRAWS"});
+	if (!indirect) return std::unexpected(indirect.error());
+	return DepthPrepass(std::move(*direct), std::move(*indirect));
+}
+
+DepthPrepass::DepthPrepass(Shader direct, Shader indirect)
+    : direct(std::move(direct))
+    , indirect(std::move(indirect)) {
+	for (auto& frame: frames) glGenQueries(4, frame.queries);
+}
+
+DepthPrepass::DepthPrepass(DepthPrepass&& other) noexcept
+    : direct(std::move(other.direct))
+    , indirect(std::move(other.indirect))
+    , current(other.current)
+    , last_stats(other.last_stats) {
+	for (size_t i = 0; i < 2; i++) {
+		frames[i] = other.frames[i];
+		std::ranges::fill(other.frames[i].queries, 0);
+	}
+}
+
+DepthPrepass::~DepthPrepass() noexcept {
+	for (auto& frame: frames) glDeleteQueries(4, frame.queries);
+}
+
+void DepthPrepass::collect() {
+	auto& frame = frames[current];
+	if (!frame.pending) return;
+	// Issued two frames ago, normally done already
+	GLuint64 times[3] = {};
+	for (int i = frame.prepass ? 0 : 1; i < 3; i++) {
+		glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+	}
+	GLuint64 samples = 0;
+	glGetQueryObjectui64v(frame.queries[3], GL_QUERY_RESULT, &samples);
+
+	last_stats = Stats {
+	    .prepass_ms = frame.prepass ? (times[1] - times[0]) / 1e6 : 0.0,
+	    .main_ms = (times[2] - times[1]) / 1e6,
+	    .shaded_samples = samples,
+	    .overdraw = frame.pixels ? (float) samples / frame.pixels : 0.f,
+	};
+	frame.pending = false;
+	frame.prepass = false;
+}
+
+Shader& DepthPrepass::begin(bool indirect, const glm::mat4& view, const glm::mat4& projection) {
+	collect();
+	frames[current].prepass = true;
+	glQueryCounter(frames[current].queries[0], GL_TIMESTAMP);
+
+	auto& shader = indirect ? this->indirect : direct;
+	shader.use();
+	shader.setMat4("view", view);
+	shader.setMat4("projection", projection);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	return shader;
+}
+
+void DepthPrepass::end() {
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+}
+
+void DepthPrepass::begin_main(int width, int height) {
+	collect();
+	auto& frame = frames[current];
+	frame.pixels = (size_t) width * height;
+	glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+	glBeginQuery(GL_SAMPLES_PASSED, frame.queries[3]);
+}
+
+void DepthPrepass::end_main() {
+	auto& frame = frames[current];
+	glEndQuery(GL_SAMPLES_PASSED);
+	glQueryCounter(frame.queries[2], GL_TIMESTAMP);
+	if (frame.prepass) {
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+	frame.pending = true;
+	current = (current + 1) % 2;
+}
@@ -0,0 +1,289 @@
+#include "geometry_pool.hpp"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+namespace {
+GLuint draw_id_buffer() {
+	static GLuint buffer = [] {
+		std::vector<GLuint> ids(GeometryPool::max_draw_ids);
+		std::iota(ids.begin(), ids.end(), 0);
+		GLuint id;
+		glGenBuffers(1, &id);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+		glBufferData(GL_COPY_WRITE_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		return id;
+	}();
+	return buffer;
+}
+} // namespace
+
+RangeAllocator::RangeAllocator(size_t capacity): total(capacity) {
+	if (capacity > 0) free_ranges[0] = capacity;
+}
+
+std::optional<size_t> RangeAllocator::allocate(size_t size, size_t alignment) {
+	for (auto it = free_ranges.begin(); it != free_ranges.end(); it++) {
+		auto [offset, free_size] = *it;
+		size_t aligned = (offset + alignment - 1) / alignment * alignment;
+		if (aligned + size > offset + free_size) continue;
+
+		free_ranges.erase(it);
+		if (aligned > offset) free_ranges[offset] = aligned - offset;
+		if (aligned + size < offset + free_size) {
+			free_ranges[aligned + size] = offset + free_size - aligned - size;
+		}
+		in_use += size;
+		return aligned;
+	}
+	return std::nullopt;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+	in_use -= size;
+	auto next = free_ranges.lower_bound(offset);
+	if (next != free_ranges.end() && offset + size == next->first) {
+		size += next->second;
+		next = free_ranges.erase(next);
+	}
+	if (next != free_ranges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+	free_ranges[offset] = size;
+}
+
+size_t RangeAllocator::largest_free() const {
+	size_t largest = 0;
+	for (const auto& [offset, size]: free_ranges) largest = std::max(largest, size);
+	return largest;
+}
+
+GeometryAllocation::GeometryAllocation(
+    GeometryPool& pool,
+    uint32_t page,
+    size_t first_vertex,
+    size_t vertex_count,
+    size_t index_offset,
+    size_t index_bytes
+)
+    : pool(pool)
+    , page(page)
+    , first_vertex(first_vertex)
+    , vertex_count(vertex_count)
+    , index_offset(index_offset)
+    , index_bytes(index_bytes) {}
+
+GeometryAllocation::~GeometryAllocation() noexcept { pool.release(*this); }
+
+GLuint GeometryPool::bound_vao = 0;
+
+GeometryPool::GeometryPool(VertexFormat format)
+    : format(format)
+    , stride(format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex))
+    , position_stride(
+          format == VertexFormat::Compact ? sizeof(CompactVertex::pos) : sizeof(Vertex::pos)
+      ) {}
+
+GeometryPool& GeometryPool::shared(VertexFormat format) {
+	// Leaked on purpose, meshes held by other statics release into it during teardown
+	static GeometryPool* full = new GeometryPool(VertexFormat::Full);
+	static GeometryPool* compact = new GeometryPool(VertexFormat::Compact);
+	return format == VertexFormat::Compact ? *compact : *full;
+}
+
+GeometryPool::Page GeometryPool::create_page(size_t vertex_count, size_t index_bytes) {
+	Page page {.vertices = RangeAllocator(vertex_count), .indices = RangeAllocator(index_bytes)};
+	glGenVertexArrays(1, &page.vao);
+	glGenBuffers(1, &page.vbo);
+	glGenBuffers(1, &page.ebo);
+
+	glBindVertexArray(page.vao);
+	bound_vao = page.vao;
+	glBindBuffer(GL_ARRAY_BUFFER, page.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * stride, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, GL_STATIC_DRAW);
+
+	if (format == VertexFormat::Compact) {
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(
+		    0,
+		    3,
+		    GL_UNSIGNED_SHORT,
+		    GL_TRUE,
+		    sizeof(CompactVertex),
+		    (void*) offsetof(CompactVertex, pos)
+		);
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(
+		    1,
+		    2,
+		    GL_SHORT,
+		    GL_TRUE,
+		    sizeof(CompactVertex),
+		    (void*) offsetof(CompactVertex, normal)
+		);
+
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(
+		    2,
+		    2,
+		    GL_HALF_FLOAT,
+		    GL_FALSE,
+		    sizeof(CompactVertex),
+		    (void*) offsetof(CompactVertex, tex_coords)
+		);
+	} else {
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, pos));
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(
+		    1,
+		    3,
+		    GL_FLOAT,
+		    GL_FALSE,
+		    sizeof(Vertex),
+		    (void*) offsetof(Vertex, normal)
+		);
+
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(
+		    2,
+		    2,
+		    GL_FLOAT,
+		    GL_FALSE,
+		    sizeof(Vertex),
+		    (void*) offsetof(Vertex, tex_coords)
+		);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, draw_id_buffer());
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+	glVertexAttribDivisor(3, 1);
+
+	// Same attribute formats as above so both VAOs produce bit identical positions
+	glGenVertexArrays(1, &page.position_vao);
+	glGenBuffers(1, &page.position_vbo);
+	glBindVertexArray(page.position_vao);
+	bound_vao = page.position_vao;
+	glBindBuffer(GL_ARRAY_BUFFER, page.position_vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * position_stride, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.ebo);
+	glEnableVertexAttribArray(0);
+	if (format == VertexFormat::Compact) {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, position_stride, nullptr);
+	} else {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, position_stride, nullptr);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, draw_id_buffer());
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+	glVertexAttribDivisor(3, 1);
+	return page;
+}
+
+std::shared_ptr<GeometryAllocation> GeometryPool::allocate(
+    std::span<const uint8_t> vertices,
+    size_t vertex_count,
+    std::span<const uint8_t> indices
+) {
+	// Index offsets stay 4 byte aligned so both index types can share a buffer
+	constexpr size_t index_alignment = sizeof(GLuint);
+
+	std::optional<size_t> first_vertex, index_offset;
+	uint32_t page = 0;
+	for (; page < pages.size(); page++) {
+		first_vertex = pages[page].vertices.allocate(vertex_count);
+		if (!first_vertex) continue;
+		index_offset = pages[page].indices.allocate(indices.size(), index_alignment);
+		if (index_offset) break;
+		pages[page].vertices.free(*first_vertex, vertex_count);
+	}
+	if (page == pages.size()) {
+		// Meshes bigger than a page get a page of their own
+		pages.push_back(create_page(
+		    std::max(page_vertex_bytes / stride, vertex_count),
+		    std::max(page_index_bytes, indices.size())
+		));
+		first_vertex = pages.back().vertices.allocate(vertex_count);
+		index_offset = pages.back().indices.allocate(indices.size(), index_alignment);
+	}
+
+	// The copy targets leave the VAO's element buffer binding alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pages[page].vbo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, *first_vertex * stride, vertices.size(), vertices.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pages[page].ebo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, *index_offset, indices.size(), indices.data());
+
+	std::vector<uint8_t> positions(vertex_count * position_stride);
+	for (size_t i = 0; i < vertex_count; i++) {
+		std::copy_n(&vertices[i * stride], position_stride, &positions[i * position_stride]);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, pages[page].position_vbo);
+	glBufferSubData(
+	    GL_COPY_WRITE_BUFFER,
+	    *first_vertex * position_stride,
+	    positions.size(),
+	    positions.data()
+	);
+
+	allocations++;
+	return std::make_shared<GeometryAllocation>(
+	    *this,
+	    page,
+	    *first_vertex,
+	    vertex_count,
+	    *index_offset,
+	    indices.size()
+	);
+}
+
+void GeometryPool::release(const GeometryAllocation& allocation) {
+	auto& page = pages[allocation.page];
+	page.vertices.free(allocation.first_vertex, allocation.vertex_count);
+	page.indices.free(allocation.index_offset, allocation.index_bytes);
+	allocations--;
+}
+
+void GeometryPool::bind(uint32_t page) {
+	if (bound_vao == pages[page].vao) return;
+	glBindVertexArray(pages[page].vao);
+	bound_vao = pages[page].vao;
+}
+
+void GeometryPool::bind_positions(uint32_t page) {
+	if (bound_vao == pages[page].position_vao) return;
+	glBindVertexArray(pages[page].position_vao);
+	bound_vao = pages[page].position_vao;
+}
+
+void GeometryPool::reset_binding() { bound_vao = 0; }
+
+GeometryPool::Stats GeometryPool::stats() const {
+	Stats stats {.pages = pages.size(), .allocations = allocations};
+	// Vertex bytes include the position stream, it shares the vertex allocator
+	size_t vertex_size = stride + position_stride;
+	size_t free_bytes = 0, largest_free = 0;
+	for (const auto& page: pages) {
+		stats.vertex_bytes_used += page.vertices.used() * vertex_size;
+		stats.vertex_bytes_capacity += page.vertices.capacity() * vertex_size;
+		stats.index_bytes_used += page.indices.used();
+		stats.index_bytes_capacity += page.indices.capacity();
+		stats.free_blocks += page.vertices.free_blocks() + page.indices.free_blocks();
+		free_bytes += (page.vertices.capacity() - page.vertices.used()) * vertex_size;
+		free_bytes += page.indices.capacity() - page.indices.used();
+		largest_free = std::max(
+		    {largest_free, page.vertices.largest_free() * vertex_size, page.indices.largest_free()}
+		);
+	}
+	stats.fragmentation = free_bytes > 0 ? 1.f - (float) largest_free / free_bytes : 0.f;
+	return stats;
+}
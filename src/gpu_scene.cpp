@@ -0,0 +1,301 @@
+#include "gpu_scene.hpp"
+#include <algorithm>
+#include <utility>
+#include <GLFW/glfw3.h>
+#include <glm/common.hpp>
+#include <glm/ext/matrix_float3x3.hpp>
+#include "geometry_pool.hpp"
+#include "hi_z_buffer.hpp"
+#include "mesh.hpp"
+
+namespace {
+// glad is generated for 4.5 without extensions, so ARB_indirect_parameters is loaded by hand
+using MultiDrawElementsIndirectCount = void(GLAD_API_PTR*)(
+    GLenum mode,
+    GLenum type,
+    const void* indirect,
+    GLintptr drawcount,
+    GLsizei maxdrawcount,
+    GLsizei stride
+);
+MultiDrawElementsIndirectCount multi_draw_elements_indirect_count = nullptr;
+constexpr GLenum parameter_buffer = 0x80EE; // GL_PARAMETER_BUFFER_ARB
+
+bool draw_count_supported() {
+	static bool supported = [] {
+		if (!glfwExtensionSupported("GL_ARB_indirect_parameters")) return false;
+		multi_draw_elements_indirect_count = (MultiDrawElementsIndirectCount) glfwGetProcAddress(
+		    "glMultiDrawElementsIndirectCountARB"
+		);
+		return multi_draw_elements_indirect_count != nullptr;
+	}();
+	return supported;
+}
+} // namespace
+
+std::expected<GpuScene, std::string> GpuScene::create() {
+	auto shader = Shader::create_compute("./shaders/gpu_cull.comp");
+	if (!shader) return std::unexpected(shader.error());
+	return GpuScene(std::move(*shader));
+}
+
+GpuScene::GpuScene(Shader shader): shader(std::move(shader)) {
+	GLuint buffers[5];
+	glGenBuffers(5, buffers);
+	draw_buffer = buffers[0];
+	record_buffer = buffers[1];
+	command_buffer = buffers[2];
+	count_buffer = buffers[3];
+	readback_buffer = buffers[4];
+	glGenQueries(1, &query);
+}
+
+GpuScene::GpuScene(GpuScene&& other) noexcept
+    : shader(std::move(other.shader))
+    , draws(std::move(other.draws))
+    , bounds(std::move(other.bounds))
+    , entries(std::move(other.entries))
+    , batches(std::move(other.batches))
+    , records(std::move(other.records))
+    , dirty(other.dirty)
+    , batched_mode(other.batched_mode)
+    , draw_buffer(std::exchange(other.draw_buffer, 0))
+    , record_buffer(std::exchange(other.record_buffer, 0))
+    , command_buffer(std::exchange(other.command_buffer, 0))
+    , count_buffer(std::exchange(other.count_buffer, 0))
+    , readback_buffer(std::exchange(other.readback_buffer, 0))
+    , readback_fence(std::exchange(other.readback_fence, nullptr))
+    , query(std::exchange(other.query, 0))
+    , query_pending(other.query_pending)
+    , last_cull_ms(other.last_cull_ms)
+    , last_visible(other.last_visible)
+    , culled(other.culled) {}
+
+GpuScene::~GpuScene() noexcept {
+	GLuint buffers[] = {draw_buffer, record_buffer, command_buffer, count_buffer, readback_buffer};
+	glDeleteBuffers(5, buffers);
+	if (readback_fence) glDeleteSync(readback_fence);
+	glDeleteQueries(1, &query);
+}
+
+uint32_t GpuScene::add_draw(const DrawData& data, const Bounds& bounds) {
+	if (draws.size() >= IndirectDraws::max_draws) return IndirectDraws::max_draws;
+	draws.push_back(data);
+	this->bounds.push_back(bounds);
+	dirty = true;
+	return draws.size() - 1;
+}
+
+void GpuScene::add_command(const Mesh& mesh, uint32_t page, const DrawCommand& command) {
+	if (command.base_instance >= draws.size()) return;
+	entries.push_back(Entry {&mesh, page, command});
+	dirty = true;
+}
+
+void GpuScene::clear() {
+	draws.clear();
+	bounds.clear();
+	entries.clear();
+	batches.clear();
+	records.clear();
+	culled = false;
+	last_visible = 0;
+	dirty = false;
+}
+
+void GpuScene::upload() {
+	dirty = false;
+	batched_mode = MaterialTable::shared().mode();
+	std::ranges::stable_sort(entries, [](const Entry& a, const Entry& b) {
+		return compare_state(*a.mesh, a.page, *b.mesh, b.page) < 0;
+	});
+	batches.clear();
+	for (uint32_t i = 0; i < entries.size(); i++) {
+		const auto& entry = entries[i];
+		if (batches.empty()) {
+			batches.push_back(Batch {entry.mesh, entry.page, i, 0});
+		} else {
+			const auto& batch = batches.back();
+			if (compare_state(*batch.mesh, batch.page, *entry.mesh, entry.page) != 0) {
+				batches.push_back(Batch {entry.mesh, entry.page, i, 0});
+			}
+		}
+		batches.back().size++;
+	}
+
+	// Boxes go to world space once, transforming a box by |M| keeps it enclosing
+	records.clear();
+	uint32_t batch = 0;
+	for (uint32_t i = 0; i < entries.size(); i++) {
+		if (batch + 1 < batches.size() && batches[batch + 1].first == i) batch++;
+		const auto& command = entries[i].command;
+		const auto& draw = draws[command.base_instance];
+		const auto& box = bounds[command.base_instance];
+		auto center = glm::vec3(draw.model * glm::vec4((box.min + box.max) * 0.5f, 1.f));
+		auto rotation = glm::mat3(draw.model);
+		for (int c = 0; c < 3; c++) rotation[c] = glm::abs(rotation[c]);
+		records.push_back(GpuCullRecord {
+		    .center = center,
+		    .batch = batch,
+		    .extent = rotation * ((box.max - box.min) * 0.5f),
+		    .draw_id = command.base_instance,
+		    .count = command.count,
+		    .first_index = command.first_index,
+		    .base_vertex = command.base_vertex,
+		    .batch_first = batches[batch].first,
+		});
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    std::max<size_t>(draws.size(), 1) * sizeof(DrawData),
+	    draws.empty() ? nullptr : draws.data(),
+	    GL_STATIC_DRAW
+	);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, record_buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    std::max<size_t>(records.size(), 1) * sizeof(GpuCullRecord),
+	    records.empty() ? nullptr : records.data(),
+	    GL_STATIC_DRAW
+	);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    std::max<size_t>(records.size(), 1) * sizeof(DrawCommand),
+	    nullptr,
+	    GL_DYNAMIC_COPY
+	);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, count_buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    (batches.size() + 1) * sizeof(uint32_t),
+	    nullptr,
+	    GL_DYNAMIC_COPY
+	);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, readback_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (readback_fence) glDeleteSync(readback_fence);
+	readback_fence = nullptr;
+}
+
+void GpuScene::read_counts() {
+	if (!readback_fence) return;
+	auto status = glClientWaitSync(readback_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	glDeleteSync(readback_fence);
+	readback_fence = nullptr;
+	uint32_t visible = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, readback_buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(visible), &visible);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	last_visible = visible;
+}
+
+void GpuScene::cull(const glm::mat4& view_projection, const HiZBuffer* occlusion) {
+	if (dirty || MaterialTable::shared().mode() != batched_mode) upload();
+	culled = false;
+	if (records.empty()) return;
+	read_counts();
+
+	if (query_pending) {
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			last_cull_ms = ns / 1e6;
+			query_pending = false;
+		}
+	}
+	if (!query_pending) glBeginQuery(GL_TIME_ELAPSED, query);
+
+	glClearNamedBufferData(count_buffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	auto frustum = Frustum::from_matrix(view_projection);
+	shader.use();
+	glUniform4fv(shader.location("planes"), 6, &frustum.planes[0].x);
+	shader.setUint("record_count", (unsigned) records.size());
+	shader.setUint("batch_count", (unsigned) batches.size());
+	shader.setBool("compact", draw_count_supported());
+	shader.setBool("hi_z", occlusion && occlusion->bind(shader, 0));
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, record_binding, record_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, command_binding, command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, count_binding, count_buffer);
+	glDispatchCompute((records.size() + 63) / 64, 1, 1);
+	// Read as draw commands and parameters, and copied for the visible count
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	culled = true;
+
+	if (!readback_fence) {
+		glCopyNamedBufferSubData(
+		    count_buffer,
+		    readback_buffer,
+		    batches.size() * sizeof(uint32_t),
+		    0,
+		    sizeof(uint32_t)
+		);
+		readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	if (!query_pending) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_pending = true;
+	}
+}
+
+void GpuScene::draw_batches(const Shader* shader) {
+	if (!culled) return;
+	bool draw_count = draw_count_supported();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, draw_buffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+	if (draw_count) glBindBuffer(parameter_buffer, count_buffer);
+
+	for (size_t i = 0; i < batches.size(); i++) {
+		const auto& batch = batches[i];
+		auto& pool = GeometryPool::shared(batch.mesh->format);
+		if (shader) {
+			batch.mesh->bind_textures(*shader);
+			pool.bind(batch.page);
+		} else {
+			pool.bind_positions(batch.page);
+		}
+		auto offset = (const void*) (batch.first * sizeof(DrawCommand));
+		if (draw_count) {
+			multi_draw_elements_indirect_count(
+			    GL_TRIANGLES,
+			    batch.mesh->index_type,
+			    offset,
+			    (GLintptr) (i * sizeof(uint32_t)),
+			    (GLsizei) batch.size,
+			    0
+			);
+		} else {
+			glMultiDrawElementsIndirect(
+			    GL_TRIANGLES,
+			    batch.mesh->index_type,
+			    offset,
+			    (GLsizei) batch.size,
+			    0
+			);
+		}
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (draw_count) glBindBuffer(parameter_buffer, 0);
+}
+
+void GpuScene::draw(const Shader& shader) { draw_batches(&shader); }
+
+void GpuScene::draw_positions() { draw_batches(nullptr); }
+
+GpuScene::Stats GpuScene::stats() const {
+	return Stats {
+	    .draws = draws.size(),
+	    .commands = entries.size(),
+	    .batches = batches.size(),
+	    .visible = last_visible,
+	    .cull_ms = last_cull_ms,
+	    .draw_count = draw_count_supported(),
+	};
+}
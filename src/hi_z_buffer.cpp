@@ -0,0 +1,252 @@
+#include "hi_z_buffer.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+#include <glm/common.hpp>
+#include <glm/ext/vector_float2.hpp>
+#include <glm/ext/vector_float4.hpp>
+
+std::expected<HiZBuffer, std::string> HiZBuffer::create() {
+	auto shader = Shader::create_compute("./shaders/hi_z_reduce.comp");
+	if (!shader) return std::unexpected(shader.error());
+	return HiZBuffer(std::move(*shader));
+}
+
+HiZBuffer::HiZBuffer(Shader shader): shader(std::move(shader)) {
+	glGenBuffers(1, &readback_buffer);
+	glGenQueries(1, &query);
+}
+
+HiZBuffer::HiZBuffer(HiZBuffer&& other) noexcept
+    : shader(std::move(other.shader))
+    , framebuffer(std::exchange(other.framebuffer, 0))
+    , depth(std::exchange(other.depth, 0))
+    , pyramid(std::exchange(other.pyramid, 0))
+    , readback_buffer(std::exchange(other.readback_buffer, 0))
+    , query(std::exchange(other.query, 0))
+    , fence(std::exchange(other.fence, nullptr))
+    , query_pending(other.query_pending)
+    , built(other.built)
+    , last_build_ms(other.last_build_ms)
+    , width(other.width)
+    , height(other.height)
+    , pyramid_levels(other.pyramid_levels)
+    , pending_levels(std::move(other.pending_levels))
+    , pending_first_level(other.pending_first_level)
+    , pending_view_projection(other.pending_view_projection)
+    , levels(std::move(other.levels))
+    , depths(std::move(other.depths))
+    , first_level(other.first_level)
+    , screen_width(other.screen_width)
+    , screen_height(other.screen_height)
+    , view_projection(other.view_projection) {}
+
+HiZBuffer::~HiZBuffer() noexcept {
+	release_targets();
+	if (fence) glDeleteSync(fence);
+	glDeleteBuffers(1, &readback_buffer);
+	glDeleteQueries(1, &query);
+}
+
+void HiZBuffer::release_targets() {
+	glDeleteFramebuffers(1, &framebuffer);
+	GLuint textures[] = {depth, pyramid};
+	glDeleteTextures(2, textures);
+	framebuffer = depth = pyramid = 0;
+}
+
+void HiZBuffer::build(int width, int height, const glm::mat4& view_projection) {
+	if (width != this->width || height != this->height || !framebuffer) {
+		release_targets();
+		this->width = width;
+		this->height = height;
+		// Same format as the default framebuffer's depth, which blits require
+		glGenTextures(1, &depth);
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(
+		    GL_FRAMEBUFFER,
+		    GL_DEPTH_STENCIL_ATTACHMENT,
+		    GL_TEXTURE_2D,
+		    depth,
+		    0
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		int base_width = std::max(width / 2, 1);
+		int base_height = std::max(height / 2, 1);
+		pyramid_levels = std::bit_width((unsigned) std::max(base_width, base_height));
+		glGenTextures(1, &pyramid);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glTexStorage2D(GL_TEXTURE_2D, pyramid_levels, GL_R32F, base_width, base_height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		pending_levels.clear();
+		pending_first_level = 0;
+		size_t offset = 0;
+		for (int level = 0; level < pyramid_levels; level++) {
+			int level_width = std::max(base_width >> level, 1);
+			int level_height = std::max(base_height >> level, 1);
+			if (level_width > readback_width) {
+				pending_first_level = level + 1;
+				continue;
+			}
+			pending_levels.push_back(Level {level_width, level_height, offset});
+			offset += (size_t) level_width * level_height;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, offset * sizeof(float), nullptr, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	if (query_pending) {
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			last_build_ms = ns / 1e6;
+			query_pending = false;
+		}
+	}
+	if (!query_pending) glBeginQuery(GL_TIME_ELAPSED, query);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	shader.use();
+	shader.setInt("source", 0);
+	glActiveTexture(GL_TEXTURE0);
+	int source_width = width;
+	int source_height = height;
+	for (int level = 0; level < pyramid_levels; level++) {
+		// Level 0 reduces the depth copy, every other level the one below it
+		glBindTexture(GL_TEXTURE_2D, level == 0 ? depth : pyramid);
+		shader.setInt("source_level", level == 0 ? 0 : level - 1);
+		glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		source_width = std::max(source_width / 2, 1);
+		source_height = std::max(source_height / 2, 1);
+		glDispatchCompute((source_width + 7) / 8, (source_height + 7) / 8, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Copied into the buffer on the GPU timeline, poll() maps it once the fence is through
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer);
+	for (size_t i = 0; i < pending_levels.size(); i++) {
+		const auto& level = pending_levels[i];
+		glGetTextureImage(
+		    pyramid,
+		    pending_first_level + (int) i,
+		    GL_RED,
+		    GL_FLOAT,
+		    level.width * level.height * sizeof(float),
+		    (void*) (level.offset * sizeof(float))
+		);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (fence) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pending_view_projection = view_projection;
+	built = true;
+
+	if (!query_pending) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_pending = true;
+	}
+}
+
+void HiZBuffer::poll() {
+	if (!fence) return;
+	auto status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+	glDeleteSync(fence);
+	fence = nullptr;
+
+	levels = pending_levels;
+	first_level = pending_first_level;
+	screen_width = width;
+	screen_height = height;
+	view_projection = pending_view_projection;
+	const auto& last = levels.back();
+	depths.resize(last.offset + last.width * last.height);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer);
+	glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, depths.size() * sizeof(float), depths.data());
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void HiZBuffer::clear() {
+	built = false;
+	levels.clear();
+	depths.clear();
+	if (fence) glDeleteSync(fence);
+	fence = nullptr;
+}
+
+bool HiZBuffer::bind(const Shader& shader, GLuint unit) const {
+	if (!built) return false;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	glActiveTexture(GL_TEXTURE0);
+	shader.setInt("hi_z_pyramid", unit);
+	shader.setInt("hi_z_levels", pyramid_levels);
+	shader.setMat4("hi_z_view_projection", pending_view_projection);
+	shader.set(shader.uniform<glm::vec2>("hi_z_screen_size"), glm::vec2(width, height));
+	return true;
+}
+
+bool HiZBuffer::occluded(const Bounds& bounds, const glm::mat4& model) const {
+	if (levels.empty()) return false;
+	auto matrix = view_projection * model;
+	auto lo = glm::vec2(1.f);
+	auto hi = glm::vec2(-1.f);
+	float nearest = 1.f;
+	for (int corner = 0; corner < 8; corner++) {
+		auto pos = glm::vec4(
+		    corner & 1 ? bounds.max.x : bounds.min.x,
+		    corner & 2 ? bounds.max.y : bounds.min.y,
+		    corner & 4 ? bounds.max.z : bounds.min.z,
+		    1.f
+		);
+		auto clip = matrix * pos;
+		if (clip.w <= 1e-5f) return false;
+		auto ndc = glm::vec3(clip) / clip.w;
+		lo = glm::min(lo, glm::vec2(ndc));
+		hi = glm::max(hi, glm::vec2(ndc));
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+	// Nothing read back says what is past the screen edge
+	if (lo.x < -1.f || lo.y < -1.f || hi.x > 1.f || hi.y > 1.f) return false;
+
+	auto screen = glm::vec2(screen_width, screen_height);
+	auto pixel_lo = (lo * 0.5f + 0.5f) * screen;
+	auto pixel_hi = (hi * 0.5f + 0.5f) * screen;
+	// The level where the rect spans about two texels, a level 0 texel covers two pixels
+	float extent = std::max({pixel_hi.x - pixel_lo.x, pixel_hi.y - pixel_lo.y, 1.f});
+	int level = (int) std::ceil(std::log2(extent)) - 2;
+	level = std::clamp(level - first_level, 0, (int) levels.size() - 1);
+	const auto& data = levels[level];
+	int shift = first_level + level + 1;
+
+	// Past the last texel means the odd pixels it took in
+	int x0 = std::min((int) pixel_lo.x >> shift, data.width - 1);
+	int y0 = std::min((int) pixel_lo.y >> shift, data.height - 1);
+	int x1 = std::min((int) pixel_hi.x >> shift, data.width - 1);
+	int y1 = std::min((int) pixel_hi.y >> shift, data.height - 1);
+	float farthest = 0.f;
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			farthest = std::max(farthest, depths[data.offset + (size_t) y * data.width + x]);
+		}
+	}
+	return nearest > farthest;
+}
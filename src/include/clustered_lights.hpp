@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include "shader.hpp"
+
+class PointLightBuffer;
+
+// Clustered forward+ light assignment. A compute pass splits the view frustum into a grid of
+// screen tiles and exponential depth slices and lists, per cluster, the point lights whose
+// range reaches it. Fragment shaders built with CLUSTERED_LIGHTS then only loop over their
+// own cluster's list. A cluster holds at most cluster_stride - 1 lights; any past that are
+// dropped from it and counted, see overflow(). GL thread only.
+class ClusteredLights {
+public:
+	static constexpr uint32_t grid_x = 16;
+	static constexpr uint32_t grid_y = 9;
+	static constexpr uint32_t grid_z = 24;
+	static constexpr uint32_t cluster_count = grid_x * grid_y * grid_z;
+	// The light count and up to 127 light indices per cluster, lights past that are dropped
+	static constexpr uint32_t cluster_stride = 128;
+	static constexpr GLuint buffer_binding = 3;
+	static constexpr GLuint overflow_binding = 8;
+
+	// Lights left out of full clusters by one assign()
+	struct Overflow {
+		size_t clusters; // clusters that had more lights in range than they hold
+		size_t lights; // light references dropped over all of them
+	};
+
+	static std::expected<ClusteredLights, std::string> create();
+	ClusteredLights(ClusteredLights&& other) noexcept;
+	~ClusteredLights() noexcept;
+
+	// Fills the cluster lists for this view from `lights`, which have to be uploaded already.
+	// Leaves the compute program bound.
+	void assign(
+	    const PointLightBuffer& lights,
+	    const glm::mat4& view,
+	    const glm::mat4& projection,
+	    float near_plane,
+	    float far_plane
+	);
+	// Sets the lookup uniforms on `shader`, which must be in use, and binds the lists.
+	// `width` and `height` are the framebuffer's, in pixels.
+	void bind(const Shader& shader, int width, int height) const;
+	// GPU time of the last assign() whose result is in, without waiting for one
+	double assign_ms() const { return last_assign_ms; }
+	// Overflow of the last assign() read back, a frame or two late
+	Overflow overflow() const { return last_overflow; }
+
+private:
+	ClusteredLights(Shader shader);
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+	// Picks up the overflow counts of an earlier assign() if the GPU is done with them
+	void read_overflow();
+
+	Shader shader;
+	GLuint buffer = 0;
+	// Dropped lights and full clusters, cleared every assign()
+	GLuint overflow_buffer = 0;
+	GLuint readback_buffer = 0;
+	GLsync readback_fence = nullptr;
+	Overflow last_overflow {};
+	GLuint query = 0;
+	bool query_pending = false;
+	double last_assign_ms = 0;
+	float near_plane = 0.1f;
+	float far_plane = 100.f;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include "vertex.hpp"
+
+// Axis aligned box and bounding sphere around a mesh's vertices.
+struct Bounds {
+	glm::vec3 min;
+	glm::vec3 max;
+	// Sphere around the box center, only as large as the farthest vertex
+	glm::vec3 center;
+	float radius;
+
+	static Bounds from_vertices(std::span<const Vertex> vertices);
+	// Still enclosing after `matrix`: the box through |M|, the sphere by its largest axis.
+	Bounds transformed(const glm::mat4& matrix) const;
+};
+static_assert(sizeof(Bounds) == 40);
+
+// Clip space frustum planes in whatever space the matrix maps from.
+struct Frustum {
+	std::array<glm::vec4, 6> planes; // xyz normal pointing inward, w distance
+
+	// Gribb & Hartmann, normalized so distances come out in that space's units
+	static Frustum from_matrix(const glm::mat4& view_projection);
+};
+
+struct CullStats {
+	size_t tested = 0;
+	size_t culled = 0;
+	size_t visible = 0;
+};
+
+// Boxes as center and half extent, one array per component, so the culling loop reads
+// consecutive floats of each and the compiler can test 4 or 8 boxes per instruction.
+struct BoxBatch {
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+
+	void add(glm::vec3 min, glm::vec3 max);
+	void clear();
+	size_t size() const { return center_x.size(); }
+};
+
+// Appends the indices of boxes that intersect `frustum` to `visible`, in ascending order.
+// Boxes straddling a plane count as visible.
+void cull_boxes(
+    const Frustum& frustum,
+    const BoxBatch& boxes,
+    std::vector<uint32_t>& visible,
+    CullStats& stats
+);
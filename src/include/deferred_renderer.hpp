@@ -0,0 +1,59 @@
+#pragma once
+#include <expected>
+#include <string>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include "shader.hpp"
+
+class PointLightBuffer;
+struct DirLight;
+
+// Deferred alternative to the forward light loop. Scene shaders built with DEFERRED_GBUFFER
+// write diffuse, specular, normal and shininess into a G-buffer, positions come back from
+// its depth. light() then adds the directional light with a full screen pass and every
+// point light by rasterizing a cube around its range, back faces only, with a GL_GEQUAL
+// depth test so only pixels the volume actually encloses get shaded. GL thread only.
+class DeferredRenderer {
+public:
+	struct Stats {
+		size_t light_volumes;
+		size_t gbuffer_bytes;
+	};
+
+	static std::expected<DeferredRenderer, std::string> create();
+	DeferredRenderer(DeferredRenderer&& other) noexcept;
+	~DeferredRenderer() noexcept;
+
+	// Binds and clears the G-buffer, (re)allocating it for a `width` x `height` framebuffer.
+	void begin_geometry(int width, int height);
+	// Lights the G-buffer into the default framebuffer and copies the scene depth there, so
+	// forward passes can follow. `lights` have to be uploaded already.
+	void light(
+	    const PointLightBuffer& lights,
+	    const DirLight& dir_light,
+	    const glm::mat4& view_projection,
+	    glm::vec3 camera_pos
+	);
+	Stats stats() const { return last_stats; }
+
+private:
+	DeferredRenderer(Shader dir_shader, Shader light_shader);
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+	void release_targets();
+
+	Shader dir_shader;
+	Shader light_shader;
+	GLuint framebuffer = 0;
+	GLuint albedo = 0;
+	GLuint normal = 0;
+	GLuint depth = 0;
+	GLuint volume_vao = 0;
+	GLuint volume_vbo = 0;
+	GLuint volume_ebo = 0;
+	GLuint empty_vao = 0;
+	int width = 0;
+	int height = 0;
+	Stats last_stats {};
+};
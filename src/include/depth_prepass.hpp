@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include "shader.hpp"
+
+// Optional depth-only pass ahead of the main scene pass. Opaque geometry is drawn from the
+// position-only streams of GeometryPool with an empty fragment shader, then the main pass
+// depth tests with GL_EQUAL and no depth writes, so the lighting shader runs about once per
+// pixel instead of once per overlapping surface. The main pass is measured with or without
+// a pre-pass so the two can be compared. GL thread only.
+class DepthPrepass {
+public:
+	struct Stats {
+		double prepass_ms; // 0 for frames without a pre-pass
+		double main_ms;
+		uint64_t shaded_samples; // fragments passing the main pass depth test
+		float overdraw; // shaded samples per framebuffer pixel
+	};
+
+	static std::expected<DepthPrepass, std::string> create();
+	DepthPrepass(DepthPrepass&& other) noexcept;
+	~DepthPrepass() noexcept;
+
+	// Masks color writes and binds the depth program for RenderQueue::execute_positions, or
+	// for IndirectDraws::submit_positions with `indirect`.
+	Shader& begin(bool indirect, const glm::mat4& view, const glm::mat4& projection);
+	// Switches to GL_EQUAL without depth writes for the main pass.
+	void end();
+	// Bracket the main pass, whether a pre-pass ran this frame or not. end_main() restores
+	// the default depth state. `width` x `height` is the framebuffer size in pixels.
+	void begin_main(int width, int height);
+	void end_main();
+	// Results of the last frame that is at least one frame old
+	Stats stats() const { return last_stats; }
+
+private:
+	struct Frame {
+		// Pre-pass start, main start and main end timestamps, then samples passed
+		GLuint queries[4];
+		bool prepass = false;
+		bool pending = false;
+		size_t pixels = 0;
+	};
+
+	DepthPrepass(Shader direct, Shader indirect);
+	DepthPrepass(const DepthPrepass&) = delete;
+	DepthPrepass& operator=(const DepthPrepass&) = delete;
+	// Reads back the queries of `frames[current]` before they are reused
+	void collect();
+
+	Shader direct;
+	Shader indirect;
+	Frame frames[2];
+	size_t current = 0;
+	Stats last_stats {};
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
+#include "vertex.hpp"
+
+// First-fit allocator over [0, capacity) with coalescing of freed neighbours.
+class RangeAllocator {
+public:
+	RangeAllocator(size_t capacity);
+	std::optional<size_t> allocate(size_t size, size_t alignment = 1);
+	void free(size_t offset, size_t size);
+
+	size_t capacity() const { return total; }
+	size_t used() const { return in_use; }
+	size_t free_blocks() const { return free_ranges.size(); }
+	size_t largest_free() const;
+
+private:
+	size_t total;
+	size_t in_use = 0;
+	std::map<size_t, size_t> free_ranges; // offset -> size
+};
+
+class GeometryPool;
+
+// A mesh's slice of a GeometryPool page, handed back to the pool with its last reference.
+class GeometryAllocation {
+public:
+	GeometryAllocation(
+	    GeometryPool& pool,
+	    uint32_t page,
+	    size_t first_vertex,
+	    size_t vertex_count,
+	    size_t index_offset,
+	    size_t index_bytes
+	);
+	~GeometryAllocation() noexcept;
+
+	GeometryPool& pool;
+	uint32_t page;
+	size_t first_vertex; // added to every base vertex when drawing
+	size_t vertex_count;
+	size_t index_offset; // bytes into the page's index buffer
+	size_t index_bytes;
+
+private:
+	GeometryAllocation(const GeometryAllocation&) = delete;
+	GeometryAllocation& operator=(const GeometryAllocation&) = delete;
+};
+
+// All static geometry of one vertex format, sub-allocated out of a few large vertex and
+// index buffers ("pages") that share one VAO each. Meshes in the same page draw without
+// rebinding anything. Every page also keeps a copy of just the positions, tightly packed
+// behind a second VAO, for depth-only passes. GL thread only.
+class GeometryPool {
+public:
+	struct Stats {
+		size_t pages;
+		size_t allocations;
+		size_t vertex_bytes_used;
+		size_t vertex_bytes_capacity;
+		size_t index_bytes_used;
+		size_t index_bytes_capacity;
+		size_t free_blocks;
+		// 1 - largest free block / total free space, over both buffers of every page
+		float fragmentation;
+	};
+
+	static constexpr size_t page_vertex_bytes = 32 << 20;
+	static constexpr size_t page_index_bytes = 16 << 20;
+	// Every page VAO has a per-instance uint at location 3 counting up from base_instance,
+	// which indirect draws use as their draw index. Enough for GpuScene's instance counts.
+	static constexpr uint32_t max_draw_ids = 1 << 20;
+
+	static GeometryPool& shared(VertexFormat format);
+	// `vertices` holds `vertex_count` vertices in this pool's format.
+	std::shared_ptr<GeometryAllocation> allocate(
+	    std::span<const uint8_t> vertices,
+	    size_t vertex_count,
+	    std::span<const uint8_t> indices
+	);
+	// Binds the VAO of `page`, skipped when it is already bound.
+	void bind(uint32_t page);
+	// Same for the position-only VAO, attribute 0 and the draw ids but no normals or uvs.
+	void bind_positions(uint32_t page);
+	Stats stats() const;
+	// Forgets which VAO is bound, for after code that binds its own.
+	static void reset_binding();
+
+private:
+	struct Page {
+		GLuint vao, vbo, ebo;
+		GLuint position_vao, position_vbo;
+		RangeAllocator vertices; // in vertices
+		RangeAllocator indices; // in bytes
+	};
+
+	GeometryPool(VertexFormat format);
+	Page create_page(size_t vertex_count, size_t index_bytes);
+	void release(const GeometryAllocation& allocation);
+	friend class GeometryAllocation;
+
+	VertexFormat format;
+	size_t stride;
+	// Positions lead both vertex layouts, the position stream keeps only those bytes
+	size_t position_stride;
+	std::vector<Page> pages;
+	size_t allocations = 0;
+	static GLuint bound_vao;
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include "culling.hpp"
+#include "indirect_draws.hpp"
+#include "material_table.hpp"
+#include "shader.hpp"
+
+class HiZBuffer;
+class Mesh;
+
+// std430 entry of the cull input, one per draw command, see shaders/gpu_cull.comp.
+struct GpuCullRecord {
+	glm::vec3 center; // world space box of the command's draw
+	uint32_t batch;
+	glm::vec3 extent;
+	uint32_t draw_id;
+	uint32_t count;
+	uint32_t first_index;
+	int32_t base_vertex;
+	uint32_t batch_first; // the batch's first slot in the command buffer
+};
+static_assert(sizeof(GpuCullRecord) == 48);
+
+// Static instances whose culling runs on the GPU. Draws, their world space boxes and command
+// templates are uploaded once. Every frame a compute pass tests each command's box against
+// the frustum, and optionally the last Hi-Z pyramid, and appends the survivors to their
+// batch's region of the indirect buffer while counting them. With
+// GL_ARB_indirect_parameters each batch is then one glMultiDrawElementsIndirectCount
+// reading that count. Without it every command keeps its slot, culled ones with an
+// instance count of 0, and the whole region is drawn. The CPU touches nothing per instance.
+// Meshes have to outlive the scene. GL thread only.
+class GpuScene {
+public:
+	struct Stats {
+		size_t draws;
+		size_t commands;
+		size_t batches;
+		size_t visible; // commands that passed, read back a frame or two late
+		double cull_ms;
+		bool draw_count; // whether batches draw with the GPU's count
+	};
+
+	static constexpr GLuint record_binding = 4;
+	static constexpr GLuint command_binding = 5;
+	static constexpr GLuint count_binding = 6;
+
+	static std::expected<GpuScene, std::string> create();
+	GpuScene(GpuScene&& other) noexcept;
+	~GpuScene() noexcept;
+
+	// Returns the id commands of this draw have to use as base_instance, or max_draws when
+	// full. `bounds` are in the draw's object space, as in Mesh::bounds.
+	uint32_t add_draw(const DrawData& data, const Bounds& bounds);
+	// Like IndirectDraws::add_command, `mesh` supplies the page, index type and textures.
+	void add_command(const Mesh& mesh, uint32_t page, const DrawCommand& command);
+	void clear();
+	bool empty() const { return entries.empty(); }
+
+	// Uploads the scene if it or the material mode changed, then culls it for
+	// `view_projection`, also against `occlusion` when that has a pyramid. Leaves the compute
+	// program bound.
+	void cull(const glm::mat4& view_projection, const HiZBuffer* occlusion);
+	// Draws what the last cull() kept with `shader`, which must be in use.
+	void draw(const Shader& shader);
+	// Same from the position-only streams with the program in use, for a depth pre-pass.
+	void draw_positions();
+	Stats stats() const;
+
+private:
+	struct Entry {
+		const Mesh* mesh;
+		uint32_t page;
+		DrawCommand command;
+	};
+	// Commands sharing everything that is bound, drawn by one multi-draw call
+	struct Batch {
+		const Mesh* mesh;
+		uint32_t page;
+		uint32_t first;
+		uint32_t size;
+	};
+
+	GpuScene(Shader shader);
+	GpuScene(const GpuScene&) = delete;
+	GpuScene& operator=(const GpuScene&) = delete;
+	void upload();
+	// Binds textures for `shader` too, or only the position streams without one
+	void draw_batches(const Shader* shader);
+	// Picks up the visible count of an earlier cull() if the GPU is done with it
+	void read_counts();
+
+	Shader shader;
+	std::vector<DrawData> draws;
+	std::vector<Bounds> bounds; // per draw, object space
+	std::vector<Entry> entries;
+	std::vector<Batch> batches;
+	std::vector<GpuCullRecord> records;
+	bool dirty = false;
+	// Whether batches split by texture set depends on this, see compare_state
+	MaterialMode batched_mode = MaterialMode::PerDraw;
+
+	GLuint draw_buffer = 0;
+	GLuint record_buffer = 0;
+	GLuint command_buffer = 0;
+	// One count per batch, then the total
+	GLuint count_buffer = 0;
+	GLuint readback_buffer = 0;
+	GLsync readback_fence = nullptr;
+	GLuint query = 0;
+	bool query_pending = false;
+	double last_cull_ms = 0;
+	size_t last_visible = 0;
+	bool culled = false;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include "culling.hpp"
+#include "shader.hpp"
+
+struct OcclusionStats {
+	size_t tested = 0;
+	size_t culled = 0;
+	size_t culled_triangles = 0;
+};
+
+// Hierarchical-Z pyramid of the scene depth, for occlusion culling against the previous
+// frame. build() copies the default framebuffer's depth and max-reduces it into a mip chain
+// with a compute pass, each texel holding the farthest depth under it, then reads the coarse
+// levels back without waiting. Once poll() picks them up, occluded() tests boxes against them
+// with the view projection they were rendered with, so a box is only hidden by what was in
+// front of it last frame. Objects coming out from behind an occluder can pop in a frame late.
+// GL thread only.
+class HiZBuffer {
+public:
+	// Levels at most this wide, and all coarser ones, are read back
+	static constexpr int readback_width = 128;
+
+	static std::expected<HiZBuffer, std::string> create();
+	HiZBuffer(HiZBuffer&& other) noexcept;
+	~HiZBuffer() noexcept;
+
+	// Builds the pyramid from the depth of the default framebuffer, `width` x `height` pixels
+	// drawn with `view_projection`, and starts reading it back.
+	void build(int width, int height, const glm::mat4& view_projection);
+	// Takes the last build's readback if the GPU is done with it, keeps the older one if not.
+	void poll();
+	// Drops the readback and the pyramid's contents, nothing is occluded until the next build.
+	void clear();
+	bool ready() const { return !levels.empty(); }
+	// Whether the object space `bounds`, placed by `model`, lie entirely behind the depth
+	// read back. Boxes crossing the near plane or the screen edge are never occluded.
+	bool occluded(const Bounds& bounds, const glm::mat4& model) const;
+	// For the same test on the GPU: binds the last built pyramid to `unit` and sets the
+	// hi_z_* uniforms on `shader`, which must be in use. False before the first build.
+	bool bind(const Shader& shader, GLuint unit) const;
+	// GPU time of the last build whose result is in, without waiting for one
+	double build_ms() const { return last_build_ms; }
+
+private:
+	struct Level {
+		int width;
+		int height;
+		size_t offset; // in floats, into `depths`
+	};
+
+	HiZBuffer(Shader shader);
+	HiZBuffer(const HiZBuffer&) = delete;
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+	void release_targets();
+
+	Shader shader;
+	GLuint framebuffer = 0;
+	GLuint depth = 0; // copy of the default framebuffer's depth
+	GLuint pyramid = 0; // R32F, level 0 is half the framebuffer size
+	GLuint readback_buffer = 0;
+	GLuint query = 0;
+	GLsync fence = nullptr;
+	bool query_pending = false;
+	bool built = false;
+	double last_build_ms = 0;
+	int width = 0;
+	int height = 0;
+	int pyramid_levels = 0;
+
+	// Layout and view projection of the build in flight
+	std::vector<Level> pending_levels;
+	int pending_first_level = 0;
+	glm::mat4 pending_view_projection;
+
+	// The last build read back, levels from `first_level` up
+	std::vector<Level> levels;
+	std::vector<float> depths;
+	int first_level = 0;
+	int screen_width = 0;
+	int screen_height = 0;
+	glm::mat4 view_projection;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include "geometry_pool.hpp"
+#include "shader.hpp"
+#include "vertex.hpp"
+
+class Mesh;
+
+// std430 entry of the per-draw buffer, see shaders/vert_indirect.glsl.
+struct DrawData {
+	glm::mat4 model;
+	glm::mat4 normal_matrix; // upper 3x3 used
+	glm::vec4 pos_offset; // w is 1 for CompactVertex meshes
+	glm::vec4 pos_scale;
+	uint32_t material; // MaterialTable row, read when the table is active
+	uint32_t padding[3];
+};
+static_assert(sizeof(DrawData) == 176);
+
+// Layout glMultiDrawElementsIndirect reads.
+struct DrawCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance; // DrawData index, reaches the shader as the draw_id attribute
+};
+
+// Orders mesh draws by what has to be bound for them, 0 when they can share a multi-draw call.
+// compare_geometry only looks at the vertex and index buffers, all a position-only pass binds.
+int compare_geometry(const Mesh& a, uint32_t a_page, const Mesh& b, uint32_t b_page);
+int compare_state(const Mesh& a, uint32_t a_page, const Mesh& b, uint32_t b_page);
+
+// Collects a frame's mesh draws and submits them with one glMultiDrawElementsIndirect per
+// batch of commands sharing a geometry page, index type and texture set. With the
+// MaterialTable active textures no longer split batches. GL thread only.
+class IndirectDraws {
+public:
+	struct Stats {
+		size_t draws; // DrawData entries
+		size_t commands;
+		size_t batches; // multi-draw calls
+		size_t position_batches; // multi-draw calls of submit_positions
+	};
+
+	static constexpr uint32_t max_draws = GeometryPool::max_draw_ids;
+
+	// Returns the id commands of this draw have to use as base_instance, or max_draws when full.
+	uint32_t add_draw(const DrawData& data);
+	// `mesh` supplies the page, index type and textures, it has to outlive submit().
+	void add_command(const Mesh& mesh, uint32_t page, const DrawCommand& command);
+	// Uploads everything queued and draws it with `shader`, which must be in use.
+	void submit(const Shader& shader);
+	// Draws everything queued from the position-only streams with the program in use, for a
+	// depth pre-pass. Textures don't split batches here. A following submit() reuses the upload.
+	void submit_positions();
+	void clear();
+	Stats stats() const { return last_stats; }
+
+private:
+	struct Entry {
+		const Mesh* mesh;
+		uint32_t page;
+		DrawCommand command;
+	};
+
+	// Sorts and uploads the queue once per clear(), false when there is nothing to draw
+	bool upload();
+
+	std::vector<DrawData> draws;
+	std::vector<Entry> entries;
+	std::vector<DrawCommand> commands;
+	GLuint draw_buffer = 0;
+	GLuint command_buffer = 0;
+	bool uploaded = false;
+	Stats last_stats {};
+};
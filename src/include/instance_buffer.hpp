@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+
+// std430 entry of the instance buffer, see shaders/no_shade_v.glsl built with INSTANCED.
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 color; // w unused
+};
+static_assert(sizeof(InstanceData) == 80);
+
+// Per-instance transforms and colors for Model::draw_instanced, which draws every instance of
+// a mesh with one glDrawElementsInstanced. Shaders index it with gl_InstanceID. Rebuilt and
+// streamed whenever it changed, usually once per frame. GL thread only.
+class InstanceBuffer {
+public:
+	static constexpr GLuint buffer_binding = 7;
+
+	void add(const glm::mat4& model, glm::vec3 color = glm::vec3(1.f));
+	void clear();
+	size_t size() const { return instances.size(); }
+	// Uploads the instances if they changed and binds the buffer.
+	void bind();
+
+private:
+	std::vector<InstanceData> instances;
+	GLuint buffer = 0;
+	bool dirty = false;
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+#include "texture_compress.hpp"
+
+// Block-compressed KTX2 file mapped back to its levels, which point into the parsed bytes.
+struct Ktx2View {
+	BlockFormat format;
+	int width;
+	int height;
+	std::vector<std::span<const uint8_t>> levels;
+};
+
+// Serializes a 2D, single layer, non-supercompressed KTX2 file.
+std::vector<uint8_t> write_ktx2(const CompressedImage& image);
+std::expected<Ktx2View, std::string> parse_ktx2(std::span<const uint8_t> bytes);
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_uint3.hpp>
+#include "culling.hpp"
+
+// Spatial index over bounding spheres of dynamic objects, for frustum and range queries.
+//
+// Cells at depth d have half size root / 2^d, and each node's bounds are twice its cell
+// ("loose"). An object goes to the deepest level whose cell half size still covers its
+// radius, into the cell holding its center, so inserting never searches and moving within a
+// cell only rewrites the sphere. Objects too big for the root cell or centered outside it
+// stay in the root, which queries never reject.
+class LooseOctree {
+public:
+	using Handle = uint32_t;
+
+	struct Stats {
+		size_t objects;
+		size_t nodes;
+		size_t root_objects; // outside the root cell or too big for it, always tested
+	};
+
+	LooseOctree(glm::vec3 center, float half_size, uint32_t max_depth = 8);
+
+	// `value` is handed back by queries, the handle stays valid until removed.
+	Handle insert(glm::vec3 center, float radius, uint32_t value);
+	void move(Handle handle, glm::vec3 center, float radius);
+	void remove(Handle handle);
+	void clear();
+	size_t size() const { return objects.size() - free_handles.size(); }
+
+	// Append the value of every object whose sphere intersects the frustum / the sphere.
+	void query(const Frustum& frustum, std::vector<uint32_t>& out) const;
+	void query(glm::vec3 center, float radius, std::vector<uint32_t>& out) const;
+	Stats stats() const;
+
+private:
+	static constexpr int32_t none = -1;
+
+	struct Node {
+		int32_t parent;
+		int32_t children[8];
+		uint32_t depth;
+		glm::uvec3 cell;
+		glm::vec3 center;
+		float loose_half_size;
+		std::vector<Handle> objects;
+	};
+	struct Object {
+		glm::vec3 center;
+		float radius;
+		uint32_t value;
+		int32_t node; // none while the handle is free
+		uint32_t slot; // position in the node's objects
+	};
+
+	// Depth and cell at that depth for a sphere, depth 0 for anything kept in the root
+	void locate(glm::vec3 center, float radius, uint32_t& depth, glm::uvec3& cell) const;
+	int32_t find_or_create(uint32_t depth, glm::uvec3 cell);
+	void link(Handle handle, int32_t node);
+	void unlink(Handle handle);
+	void prune(int32_t node);
+	void collect(int32_t node, std::vector<uint32_t>& out) const;
+	void query_node(int32_t node, const Frustum& frustum, std::vector<uint32_t>& out) const;
+	void query_node(int32_t node, glm::vec3 center, float radius, std::vector<uint32_t>& out)
+	    const;
+
+	glm::vec3 root_center;
+	float root_half_size;
+	uint32_t max_depth;
+	std::vector<Node> nodes; // 0 is the root
+	std::vector<int32_t> free_nodes;
+	std::vector<Object> objects;
+	std::vector<Handle> free_handles;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+
+// Read-only mmap of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+	static std::expected<MappedFile, std::string> open(const std::string& path);
+	std::span<const uint8_t> bytes() const;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile() noexcept;
+
+private:
+	MappedFile(void* data, size_t size);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	void* data;
+	size_t size;
+};
+
+// 64-bit FNV-1a, used to key baked data on the contents of its source file.
+uint64_t hash_bytes(std::span<const uint8_t> bytes);
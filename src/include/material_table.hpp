@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+#include "shader.hpp"
+
+struct Texture;
+class GLTexture;
+class MaterialTable;
+
+// How meshes hand their textures to the fragment shader.
+enum class MaterialMode {
+	PerDraw, // texture units rebound before every draw, see Mesh::bind_textures
+	Bindless, // ARB_bindless_texture handles stored in the material buffer
+	TextureArray, // same sized textures copied into layers of a few GL_TEXTURE_2D_ARRAYs
+};
+
+// std430 entry of the material buffer, see shaders/frag.glsl.
+struct MaterialRecord {
+	// Bindless: 64 bit handle split in two. TextureArray: array slot and layer.
+	uint32_t diffuse[4][2];
+	uint32_t specular[4][2];
+	int32_t diff_number;
+	int32_t spec_number;
+};
+static_assert(sizeof(MaterialRecord) == 72);
+
+// A texture set's row in the MaterialTable, freed with its last reference.
+class MaterialSlot {
+public:
+	MaterialSlot(MaterialTable& table, uint32_t index);
+	~MaterialSlot() noexcept;
+
+	MaterialTable& table;
+	uint32_t index;
+
+private:
+	MaterialSlot(const MaterialSlot&) = delete;
+	MaterialSlot& operator=(const MaterialSlot&) = delete;
+};
+
+// Every live material in one shader storage buffer, so draws only pass an index instead of
+// rebinding texture units. Meshes with the same textures share a slot. GL thread only.
+class MaterialTable {
+public:
+	struct Stats {
+		size_t materials;
+		size_t uploads; // material buffer uploads so far
+		size_t arrays;
+		size_t array_layers;
+		size_t array_bytes;
+		size_t overflow; // textures that didn't fit an array and sample as white
+	};
+
+	// Texture arrays are picked with a constant index switch in the shader
+	static constexpr size_t max_arrays = 8;
+	static constexpr size_t max_textures = 4; // per type and material
+	static constexpr GLuint buffer_binding = 1;
+
+	static MaterialTable& shared();
+	// Loads the ARB_bindless_texture entry points on first call, needs a current context.
+	static bool bindless_supported();
+	static void release_handle(uint64_t handle);
+
+	MaterialMode mode() const { return current; }
+	bool active() const { return current != MaterialMode::PerDraw; }
+	std::expected<void, std::string> set_mode(MaterialMode mode);
+	std::shared_ptr<MaterialSlot> acquire(std::span<const Texture> textures);
+	void release(uint32_t index);
+	// Uploads pending changes and binds the table for `shader`, which must be in use.
+	void bind(const Shader& shader);
+	// Forget the bound state, for code that binds textures behind the table's back.
+	static void reset_binding();
+	Stats stats() const;
+
+private:
+	struct Entry {
+		std::vector<std::shared_ptr<GLTexture>> diffuse;
+		std::vector<std::shared_ptr<GLTexture>> specular;
+		std::vector<GLuint> key;
+		std::weak_ptr<MaterialSlot> slot;
+	};
+	struct ArrayKey {
+		int width;
+		int height;
+		int levels;
+		GLenum internal_format;
+		auto operator<=>(const ArrayKey&) const = default;
+	};
+	struct Layer {
+		uint32_t array;
+		uint32_t layer;
+	};
+
+	void upload();
+	void build_arrays();
+	void encode(GLTexture& texture, uint32_t (&out)[2]);
+
+	MaterialMode current = MaterialMode::PerDraw;
+	std::vector<Entry> entries;
+	std::vector<uint32_t> free_indices;
+	// Texture ids, diffuse then a 0 then specular
+	std::map<std::vector<GLuint>, uint32_t> lookup;
+	std::vector<MaterialRecord> records;
+	std::map<GLuint, Layer> layers;
+	std::vector<GLuint> arrays;
+	GLuint buffer = 0;
+	bool dirty = true;
+	bool arrays_dirty = true;
+	Stats counters {};
+	static GLuint bound_program;
+};
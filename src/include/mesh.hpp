@@ -1,31 +1,119 @@
-#include <glm/ext/vector_float2.hpp>
+#pragma once
 #include <glm/ext/vector_float3.hpp>
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <glad/gl.h>
+#include "culling.hpp"
+#include "meshlet.hpp"
 #include "shader.hpp"
-struct Vertex {
-	glm::vec3 pos;
-	glm::vec3 normal;
-	glm::vec2 tex_coords;
-};
+#include "vertex.hpp"
+
+class GLTexture;
+class GeometryAllocation;
+class GpuScene;
+class IndirectDraws;
+class MaterialSlot;
 
 struct Texture {
 	GLuint id;
 	std::string type;
 	std::string path;
+	// Keeps the shared GL texture alive, see TextureCache.
+	std::shared_ptr<GLTexture> handle;
+};
+
+// Run of indices drawn with one glDrawElementsBaseVertex call.
+struct IndexRange {
+	GLsizei count;
+	size_t offset; // bytes into the index buffer
+	GLint base_vertex;
+};
+
+// Simplified index buffer over the same vertices as the full mesh.
+struct LodView {
+	std::span<const GLuint> indices;
+	float error; // object space distance from the full mesh
 };
 
 class Mesh {
 public:
-	Mesh(std::vector<Vertex> verts, std::vector<unsigned int> indicies, std::vector<Texture> textures);
+	// Fraction of the threshold a coarser level has to stay under before it's picked, so a
+	// mesh sitting right at a switching distance doesn't flip levels every frame.
+	static constexpr float lod_hysteresis = 0.75f;
+
+	Mesh(
+	    std::span<const Vertex> vertices,
+	    std::span<const GLuint> indices,
+	    std::vector<Texture> textures,
+	    const Bounds& bounds,
+	    VertexFormat format = VertexFormat::Full,
+	    std::span<const LodView> lod_levels = {},
+	    std::span<const Meshlet> meshlets = {}
+	);
 	void draw(const Shader& shader) const;
+	// Draws the current level `instance_count` times with one call per index range.
+	void draw_instanced(const Shader& shader, GLsizei instance_count) const;
+	// Draws the full-detail meshlets listed in `visible` (ascending), merging neighbours.
+	void draw_meshlets(const Shader& shader, std::span<const uint32_t> visible) const;
+	// Same as draw and draw_meshlets, but recorded into `draws` reading DrawData `draw_id`.
+	void queue(IndirectDraws& draws, uint32_t draw_id) const;
+	void queue(GpuScene& scene, uint32_t draw_id) const;
+	void queue_meshlets(
+	    IndirectDraws& draws,
+	    uint32_t draw_id,
+	    std::span<const uint32_t> visible
+	) const;
+	// Binds the textures and sets the material uniforms, or only the material index when the
+	// MaterialTable is active.
+	void bind_textures(const Shader& shader) const;
+	// Row of this mesh's textures in MaterialTable::shared()
+	uint32_t material_index() const;
+	// Binds the geometry page and sets the vertex decode uniforms.
+	void bind_geometry(const Shader& shader) const;
+	// Binds the position-only stream instead, for depth-only passes. Draws stay the same.
+	void bind_positions(const Shader& shader) const;
+	// Draws the current level, or the `visible` meshlets, with textures and geometry bound.
+	void draw_bound() const;
+	void draw_bound(std::span<const uint32_t> visible) const;
+	// GeometryPool page holding the mesh, meshes on the same page share a VAO.
+	uint32_t page() const;
+	// Picks the coarsest level whose error stays under `threshold` pixels, given how many
+	// pixels one object space unit covers at the mesh's distance.
+	void select_lod(float pixels_per_unit, float threshold);
+
+	struct Lod {
+		GLsizei index_count;
+		float error;
+		std::vector<IndexRange> index_ranges;
+	};
 
 public:
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
+	// All levels share one index buffer, level 0 is the full mesh.
+	std::vector<Lod> lods;
+	size_t lod = 0;
+	// GL_UNSIGNED_SHORT whenever the mesh, or each of its ranges, spans under 65536 vertices.
+	GLenum index_type;
+	// Object space box and sphere, see Model::process_mesh
+	Bounds bounds;
+	VertexFormat format;
+	// Dequantization of CompactVertex::pos, identity for full vertices.
+	glm::vec3 pos_offset;
+	glm::vec3 pos_scale;
 	std::vector<Texture> textures;
+	std::shared_ptr<MaterialSlot> material;
+	// Clusters of level 0, kept on the CPU for culling
+	std::vector<Meshlet> meshlets;
 
 private:
-	GLuint VAO, VBO, EBO;
+	size_t index_size() const;
+	// Calls `fn(count, first index in the page, base vertex)` for each draw of the current
+	// level, or of the `visible` meshlets when `meshlets_only` is set.
+	template <typename F>
+	void for_each_range(bool meshlets_only, std::span<const uint32_t> visible, F&& fn) const;
+
+	// Vertex and index range in the shared GeometryPool of `format`
+	std::shared_ptr<GeometryAllocation> geometry;
 };
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glad/gl.h>
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "transform_hierarchy.hpp"
+
+enum class ImageEncoding : int32_t {
+	Raw, // tightly packed 8 bit pixels, `channels` per texel
+	Ktx2, // block-compressed KTX2 file with its mip chain
+};
+
+// Texture payload ready for upload, either decoded pixels or a KTX2 file.
+struct ImageView {
+	std::string_view type;
+	std::string_view path;
+	int width;
+	int height;
+	int channels;
+	ImageEncoding encoding;
+	std::span<const uint8_t> pixels;
+};
+
+// Final geometry of one mesh. `textures` index into the model's images.
+struct MeshView {
+	std::span<const Vertex> vertices;
+	std::span<const GLuint> indices;
+	std::span<const uint32_t> textures;
+	// Simplified levels, coarsest last
+	std::vector<LodView> lods;
+	// Clusters of the full-detail indices
+	std::span<const Meshlet> meshlets;
+	Bounds bounds;
+	// SceneNode placing the mesh in the model
+	uint32_t node = 0;
+};
+
+// Everything a baked cache depends on besides the format version.
+struct CacheKey {
+	uint64_t source_hash;
+	uint32_t import_flags; // Assimp post-processing steps
+	uint32_t bake_options; // ModelOptions that change the baked data
+	bool operator==(const CacheKey&) const = default;
+};
+
+// Baked `<model>.meshcache` file stored next to the source model, holding everything
+// Model::create would otherwise get out of Assimp and stb. Loading mmaps the file and
+// hands out views straight into the mapping.
+class MeshCache {
+public:
+	// Bump whenever the layout of the file or of Vertex, or what its fields hold, changes.
+	static constexpr uint32_t version = 7;
+
+	static std::expected<MeshCache, std::string> open(const std::string& path, const CacheKey& key);
+	static std::expected<void, std::string> write(
+	    const std::string& path,
+	    const CacheKey& key,
+	    std::span<const MeshView> meshes,
+	    std::span<const ImageView> images,
+	    std::span<const SceneNode> nodes
+	);
+
+	std::vector<MeshView> meshes;
+	std::vector<ImageView> images;
+	std::span<const SceneNode> nodes;
+
+private:
+	MeshCache(MappedFile file);
+	MappedFile file;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
+#include "mesh.hpp"
+
+// Post-transform vertex cache efficiency of an index buffer under a FIFO cache model.
+struct VertexCacheStats {
+	float acmr; // average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+	float atvr; // average transform to vertex ratio, 1 is ideal
+};
+
+VertexCacheStats analyze_vertex_cache(
+    std::span<const GLuint> indices,
+    size_t vertex_count,
+    size_t cache_size = 16
+);
+
+// Tipsify (Sander et al. 2007): reorders triangles for vertex cache reuse in linear time.
+std::vector<GLuint> optimize_vertex_cache(
+    std::span<const GLuint> indices,
+    size_t vertex_count,
+    size_t cache_size = 16
+);
+
+// Splits cache-optimized indices into clusters and sorts them outside-in so nearer,
+// outward-facing triangles are drawn first. `threshold` bounds how much ACMR may worsen.
+std::vector<GLuint> optimize_overdraw(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    float threshold = 1.05f,
+    size_t cache_size = 16
+);
+
+// Renumbers vertices in first-use order and drops unreferenced ones.
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include "vertex.hpp"
+
+// Run of up to ~64 vertices / 124 triangles out of a mesh's full index buffer, with the
+// bounds needed to cull it as a whole.
+struct Meshlet {
+	uint32_t index_offset; // first index in the full (LOD 0) index buffer
+	uint32_t index_count;
+	// Object space bounding sphere
+	glm::vec3 center;
+	float radius;
+	// Normal cone: every triangle faces away from a camera at `pos` once
+	// dot(center - pos, cone_axis) >= cone_cutoff * length(center - pos) + radius.
+	glm::vec3 cone_axis;
+	float cone_cutoff; // 1 with a zero axis when the normals are too spread to ever cull
+};
+
+// Splits `indices` into meshlets in the order they come in. Triangles are left where they
+// are so each meshlet stays a contiguous index range, the cache-optimized order already
+// keeps neighbouring triangles together.
+std::vector<Meshlet> build_meshlets(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t max_vertices = 64,
+    size_t max_triangles = 124
+);
+
+// Frustum planes and camera position in the object space of one mesh.
+struct ClusterCullView {
+	std::array<glm::vec4, 6> planes; // xyz normal pointing inward, w distance
+	glm::vec3 camera_pos;
+
+	static ClusterCullView create(const glm::mat4& model_view_projection, glm::vec3 camera_pos);
+};
+
+struct ClusterCullStats {
+	size_t tested = 0;
+	size_t frustum_culled = 0;
+	size_t backface_culled = 0;
+};
+
+// Appends the indices of meshlets that are inside the frustum and not backfacing to `visible`,
+// in ascending order.
+void cull_meshlets(
+    std::span<const Meshlet> meshlets,
+    const ClusterCullView& view,
+    std::vector<uint32_t>& visible,
+    ClusterCullStats& stats
+);
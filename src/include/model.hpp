@@ -1,42 +1,254 @@
+#pragma once
 #include "assimp/scene.h"
+#include "culling.hpp"
+#include "gpu_scene.hpp"
+#include "hi_z_buffer.hpp"
+#include "indirect_draws.hpp"
+#include "instance_buffer.hpp"
 #include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "meshlet.hpp"
+#include "render_queue.hpp"
 #include "shader.hpp"
 #include <assimp/material.h>
 #include <assimp/mesh.h>
+#include <assimp/postprocess.h>
+#include <cstdint>
+#include <expected>
+#include <future>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <optional>
 #include <string>
+#include <variant>
 #include <vector>
+#include "simplifier.hpp"
+#include "thread_pool.hpp"
+#include "transform_hierarchy.hpp"
+
+// Decoded texture pixels owned by the CPU until upload.
+struct ImageData {
+	std::string type;
+	// Resolved file path, so models reaching one file by different relative paths share it.
+	// Embedded textures keep Assimp's name for them.
+	std::string path;
+	int width;
+	int height;
+	int channels;
+	ImageEncoding encoding = ImageEncoding::Raw;
+	std::vector<uint8_t> pixels;
+
+	ImageView view() const;
+};
+
+// Geometry of one mesh as produced by the importer. `textures` index into ModelData::images.
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<uint32_t> textures;
+	std::vector<LodLevel> lods;
+	std::vector<Meshlet> meshlets;
+	Bounds bounds;
+	// Index into ModelData::nodes
+	uint32_t node = 0;
+
+	MeshView view() const;
+};
+
+struct ModelData {
+	std::vector<MeshData> meshes;
+	std::vector<ImageData> images;
+	// The aiNode tree, flattened with parents first
+	std::vector<SceneNode> nodes;
+
+	std::vector<MeshView> mesh_views() const;
+	std::vector<ImageView> image_views() const;
+};
+
+// Per-model load settings. The ones that change baked data are part of the mesh cache key.
+struct ModelOptions {
+	// Encode textures to BC formats with a precomputed mip chain while baking.
+	bool compress_textures = true;
+	// BC7 instead of BC1/BC3 for colour maps, better quality but slower to bake.
+	bool high_quality_textures = false;
+	// Reorder triangles and vertices for post-transform cache, overdraw and fetch locality.
+	bool optimize_meshes = true;
+	// Bake simplified LOD levels for Model::draw to switch between with distance.
+	bool generate_lods = true;
+	// Split meshes into meshlets with culling bounds, see DrawView::cull_clusters.
+	bool build_meshlets = true;
+	// Layout of the GPU vertex buffers, picked at upload so it doesn't touch the bake.
+	VertexFormat vertex_format = VertexFormat::Full;
+
+	uint32_t bake_options() const;
+};
+
+// Where a model is seen from, for picking mesh LOD levels and culling meshlets.
+struct DrawView {
+	glm::mat4 model;
+	glm::mat4 view_projection;
+	glm::vec3 camera_pos;
+	// Pixels covered by one world unit at distance 1: viewport_height * projection[1][1] / 2
+	float projection_scale;
+	// Largest simplification error allowed on screen, in pixels.
+	float lod_threshold = 1.f;
+	// Skip meshes whose bounding box is outside the view frustum.
+	bool cull_meshes = true;
+	// Skip off-screen and backfacing meshlets of meshes drawn at full detail.
+	bool cull_clusters = false;
+	// Skip meshes this pyramid shows hidden last frame, after frustum culling.
+	const HiZBuffer* occlusion = nullptr;
+	// Record into this batch instead of drawing, it is submitted by the caller.
+	IndirectDraws* indirect = nullptr;
+};
+
+// Everything Model::upload needs: either mmapped from the mesh cache or freshly imported.
+using ModelSource = std::variant<MeshCache, ModelData>;
+
 class Model {
 public:
+	// Draws every mesh at its node, setting `model` and `normalMatrix` per mesh, so the model
+	// sits at the origin. Use the DrawView overload to place it.
 	void draw(const Shader& shader);
-	static std::expected<Model, std::string> create(const std::string& path);
+	// Switches each mesh to the coarsest LOD level that looks the same from `view`, then draws.
+	void draw(const Shader& shader, const DrawView& view);
+	// Draws every mesh once per entry of `instances`, at the LOD level it is on, with
+	// `shader` built with INSTANCED, which puts the mesh's `node` matrix under each instance's.
+	// One draw call per mesh however many instances there are.
+	void draw_instanced(const Shader& shader, InstanceBuffer& instances);
+	// Picks LOD levels like draw, then submits every mesh to `queue` instead of drawing.
+	void enqueue(RenderQueue& queue, RenderQueue::Pass pass, Shader& shader, const DrawView& view);
+	// Adds an instance of every mesh, at the LOD level it is on, to the static `scene`.
+	void add_instance(GpuScene& scene, const glm::mat4& transform) const;
+	// The imported node tree. Changed locals are picked up by the next draw or enqueue,
+	// add_instance uses the matrices as of then.
+	TransformHierarchy& transforms() { return nodes; }
+	static std::expected<Model, std::string>
+	create(const std::string& path, const ModelOptions& options = {});
+	// Creates the GL objects for a loaded model, must run on the GL thread.
+	static Model upload(const ModelSource& source, const ModelOptions& options = {});
+	// CPU half of create: reads the mesh cache or imports and rebakes it. Touches no GL state.
+	static std::expected<ModelSource, std::string>
+	load(const std::string& path, const ModelOptions& options = {});
+	// Untextured unit cube drawn in place of models that are still loading.
+	static Model& placeholder();
+
+	// Runs Assimp and decodes every texture on `pool`. Touches no GL state.
+	static std::expected<ModelData, std::string>
+	import(const std::string& path, const ModelOptions& options, ThreadPool& pool);
+
+	static constexpr uint32_t import_flags =
+	    aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals;
 
 private:
+	// Encoded bytes of a texture that still has to be decoded.
+	struct TextureSource {
+		const aiTexture* embedded;
+		std::string file_path;
+	};
+	struct ImportState {
+		ModelOptions options;
+		ModelData data;
+		std::vector<TextureSource> texture_sources;
+	};
+
+	static Model upload(
+	    std::span<const MeshView> meshes,
+	    std::span<const ImageView> images,
+	    std::span<const SceneNode> nodes,
+	    const ModelOptions& options
+	);
 	static void process_node(
 	    const aiNode* node,
 	    const aiScene* scene,
-	    std::vector<Mesh>& meshes,
 	    const std::string& dir,
-	    std::vector<Texture>& textures_loaded
+	    ImportState& state,
+	    uint32_t parent = TransformHierarchy::no_parent
 	);
-	static Mesh process_mesh(
+	static MeshData process_mesh(
 	    const aiMesh* mesh,
 	    const aiScene* scene,
 	    const std::string& dir,
-	    std::vector<Texture>& textures_loaded
+	    ImportState& state
 	);
-	static std::vector<Texture> load_material_textures(
+	static std::vector<uint32_t> load_material_textures(
 	    const aiMaterial* mat,
 	    const aiScene* scene,
 	    aiTextureType type,
 	    const std::string& type_name,
 	    const std::string& dir,
-	    std::vector<Texture>& textures_loaded
+	    ImportState& state
+	);
+	static std::expected<ImageData, std::string> gen_embedded_texture(const aiTexture* texture);
+	// Prefers a `<path>.ktx2` next to the image when `options` compress textures
+	static std::expected<ImageData, std::string>
+	texture_from_path(const char* path, const ModelOptions& options);
+	static std::expected<ImageData, std::string> texture_from_ktx2(const std::string& path);
+	static void compress_texture(ImageData& image, const ModelOptions& options);
+	static Texture upload_texture(const ImageView& image);
+	// Without `nodes` every mesh sits at the model origin
+	Model(
+	    std::vector<Mesh> meshes,
+	    std::span<const SceneNode> nodes = {},
+	    std::vector<uint32_t> mesh_nodes = {}
 	);
-	static Texture
-	gen_embedded_texture(const aiTexture* texture, const std::string type_name, std::string path);
-	static Texture texture_from_path(const char* path, const char* type_name);
-	Model(std::vector<Mesh> meshes);
+	// Recomputes dirty node matrices and the boxes of the meshes they move
+	void update_nodes();
+	// Model matrix of mesh `index` under `view`
+	glm::mat4 mesh_model(const DrawView& view, uint32_t index) const;
+	void select_lods(const DrawView& view);
+	// Fills visible_meshes with the meshes `view` can see, or all of them without culling.
+	// Runs after select_lods, the occlusion stats count the triangles of the picked levels.
+	void cull_meshes(const DrawView& view);
+	// Fills visible_meshlets when `view` asks for cluster culling and `mesh`, placed by
+	// `model`, can be culled.
+	bool cull_clusters(const Mesh& mesh, const DrawView& view, const glm::mat4& model);
+
+public:
+	// Mesh and meshlet culling counters of the last draw
+	CullStats mesh_stats;
+	OcclusionStats occlusion_stats;
+	ClusterCullStats cluster_stats;
 
 private:
 	std::vector<Mesh> meshes;
+	TransformHierarchy nodes;
+	// Node of each of `meshes`
+	std::vector<uint32_t> mesh_nodes;
+	// Model space bounds of `meshes`, in the same order, through their node's world matrix
+	std::vector<Bounds> mesh_bounds;
+	BoxBatch mesh_boxes;
+	std::vector<uint32_t> visible_meshes;
+	std::vector<uint32_t> visible_meshlets;
+};
+
+// Model loaded on a background thread. Draws Model::placeholder until the import finishes,
+// then uploads the real meshes on the next draw.
+class ModelHandle {
+public:
+	// Returns immediately, the file is read and parsed on its own thread.
+	static ModelHandle load(const std::string& path, const ModelOptions& options = {});
+	// Uploads the model if its load has finished. Must run on the GL thread.
+	bool poll();
+	void draw(const Shader& shader);
+	void draw(const Shader& shader, const DrawView& view);
+	void draw_instanced(const Shader& shader, InstanceBuffer& instances);
+	void enqueue(RenderQueue& queue, RenderQueue::Pass pass, Shader& shader, const DrawView& view);
+	bool ready() const { return model.has_value(); }
+	// The uploaded model, null while loading.
+	const Model* get() const { return model ? &*model : nullptr; }
+	const std::string& path() const { return source_path; }
+	// Why the load failed, the handle keeps drawing the placeholder after that.
+	const std::optional<std::string>& error() const { return load_error; }
+
+private:
+	ModelHandle(
+	    std::string path,
+	    ModelOptions options,
+	    std::future<std::expected<ModelSource, std::string>> pending
+	);
+	std::string source_path;
+	ModelOptions options;
+	std::future<std::expected<ModelSource, std::string>> pending;
+	std::optional<Model> model;
+	std::optional<std::string> load_error;
 };
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include <glad/gl.h>
+#include <glm/ext/matrix_float3x3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include "mesh.hpp"
+#include "shader.hpp"
+
+struct SortItem {
+	uint64_t key;
+	uint32_t index;
+};
+
+// LSD radix sort by key, 8 bits per pass. Passes where every key has the same byte are
+// skipped, which is most of them for keys built from a handful of states.
+void radix_sort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+// Per-frame list of mesh draws, sorted by packed 64 bit keys before execution so state
+// changes only happen where the key changes. GL thread only.
+//
+// Opaque keys, high to low bits: pass 4 | program 8 | material 16 | geometry 8 | depth 24.
+// Transparent keys move the inverted depth right after the pass to draw back to front.
+class RenderQueue {
+public:
+	enum class Pass : uint8_t {
+		Opaque,
+		Transparent,
+	};
+
+	struct Stats {
+		size_t draws;
+		size_t program_changes;
+		size_t material_changes;
+		size_t geometry_changes;
+		size_t position_draws; // depth pre-pass draws, see execute_positions
+		double sort_ms;
+	};
+
+	// Sets the view used to quantize depth and clears last frame's draws and stats.
+	void begin(glm::vec3 camera_pos, glm::vec3 camera_forward, float far_plane);
+	// With `visible_meshlets` only those are drawn, see Mesh::draw_meshlets. Shader and mesh
+	// have to outlive execute().
+	void submit(
+	    Pass pass,
+	    Shader& shader,
+	    const Mesh& mesh,
+	    const glm::mat4& model,
+	    std::optional<std::span<const uint32_t>> visible_meshlets = std::nullopt
+	);
+	// Sorts and issues every draw submitted since the last execute(), then drops them so
+	// more can be queued for a later pass. Frame-wide uniforms must already be set on each
+	// program.
+	void execute();
+	// Draws the opaque submissions front to back from their position-only streams with
+	// `shader`, which must be in use, for a depth pre-pass. Leaves them queued for execute().
+	void execute_positions(const Shader& shader);
+	// Totals of every execute since begin()
+	Stats stats() const { return last_stats; }
+
+private:
+	struct Command {
+		Pass pass;
+		Shader* shader;
+		const Mesh* mesh;
+		glm::mat4 model;
+		glm::mat3 normal_matrix;
+		uint16_t material;
+		bool meshlets_only;
+		// Range of meshlet_indices
+		uint32_t first_meshlet;
+		uint32_t meshlet_count;
+	};
+	// Per-draw uniforms, resolved again whenever execute() switches programs
+	struct DrawUniforms {
+		Uniform<glm::mat4> model;
+		Uniform<glm::mat3> normal_matrix;
+		Uniform<unsigned> material_index;
+	};
+
+	uint64_t make_key(const Command& command, uint32_t program, float depth) const;
+	uint32_t program_index(GLuint program);
+	uint16_t material_index(const Mesh& mesh);
+
+	glm::vec3 camera_pos;
+	glm::vec3 camera_forward;
+	float far_plane = 1.f;
+	std::vector<Command> commands;
+	std::vector<uint32_t> meshlet_indices;
+	std::vector<SortItem> items;
+	std::vector<SortItem> scratch;
+	// Small ids for the key fields, kept across frames
+	std::unordered_map<GLuint, uint32_t> programs;
+	std::unordered_map<uint64_t, uint16_t> materials;
+	Stats last_stats {};
+};
@@ -1,33 +1,169 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <glad/gl.h>
 #include <expected>
+#include <glm/ext/matrix_float3x3.hpp>
 #include <glm/ext/matrix_float4x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/vector_float2.hpp>
 #include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_uint3.hpp>
+
+// FNV-1a hash of a uniform name. Literals hash at compile time, names with runtime indices are
+// built with at() and member() so nothing gets formatted.
+class UniformName {
+public:
+	template <size_t N>
+	consteval UniformName(const char (&name)[N]) {
+		append(std::string_view(name, N - 1));
+	}
+	explicit constexpr UniformName(std::string_view name) { append(name); }
+
+	// name[index]
+	constexpr UniformName at(size_t index) const {
+		char digits[20];
+		size_t count = 0;
+		do {
+			digits[count++] = '0' + index % 10;
+			index /= 10;
+		} while (index);
+
+		auto result = *this;
+		result.append('[');
+		while (count) result.append(digits[--count]);
+		result.append(']');
+		return result;
+	}
+	// name.member
+	constexpr UniformName member(std::string_view member) const {
+		auto result = *this;
+		result.append('.');
+		result.append(member);
+		return result;
+	}
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+private:
+	constexpr void append(char c) { hash = (hash ^ (uint8_t) c) * 0x100000001b3ull; }
+	constexpr void append(std::string_view text) {
+		for (char c: text) append(c);
+	}
+};
+
+// Location of a uniform checked against its reflected type, resolve once with
+// Shader::uniform and keep for as long as the program lives.
+template <typename T>
+struct Uniform {
+	GLint location = -1;
+};
+
+template <typename T>
+constexpr GLenum gl_uniform_type = 0;
+template <>
+inline constexpr GLenum gl_uniform_type<bool> = GL_BOOL;
+template <>
+inline constexpr GLenum gl_uniform_type<int> = GL_INT;
+template <>
+inline constexpr GLenum gl_uniform_type<unsigned> = GL_UNSIGNED_INT;
+template <>
+inline constexpr GLenum gl_uniform_type<float> = GL_FLOAT;
+template <>
+inline constexpr GLenum gl_uniform_type<glm::vec2> = GL_FLOAT_VEC2;
+template <>
+inline constexpr GLenum gl_uniform_type<glm::vec3> = GL_FLOAT_VEC3;
+template <>
+inline constexpr GLenum gl_uniform_type<glm::uvec3> = GL_UNSIGNED_INT_VEC3;
+template <>
+inline constexpr GLenum gl_uniform_type<glm::mat3> = GL_FLOAT_MAT3;
+template <>
+inline constexpr GLenum gl_uniform_type<glm::mat4> = GL_FLOAT_MAT4;
 
 class Shader {
 public:
+	// Active uniform outside any block, as reflected after linking.
+	struct UniformInfo {
+		std::string name;
+		GLint location;
+		GLenum type;
+		GLint array_size;
+	};
+	// Active uniform or shader storage block.
+	struct BlockInfo {
+		std::string name;
+		GLenum interface; // GL_UNIFORM_BLOCK or GL_SHADER_STORAGE_BLOCK
+		GLint binding;
+		GLint data_size; // bytes, without the unsized array of a storage block
+	};
+
 	GLuint id;
+	// `defines` are inserted after the #version line of both stages as `#define <name>`.
+	static std::expected<Shader, std::string> create(
+	    const char* vertexPath,
+	    const char* fragmentPath,
+	    const std::vector<std::string>& defines = {}
+	);
 	static std::expected<Shader, std::string>
-	create(const char* vertexPath, const char* fragmentPath);
+	create_compute(const char* computePath, const std::vector<std::string>& defines = {});
 	void use();
-	void setBool(const char* name, bool v) const;
-	void setFloat(const char* name, float v) const;
-	void setInt(const char* name, int v) const;
-	void setMat4(const char* name, float* v) const;
-	void setMat4(const char* name, const glm::mat4&) const;
-	void setMat3(const char* name, const glm::mat3&) const;
-	void setMat3(const char* name, float* v) const;
-	void setVec3(const char* name, float v1, float v2, float v3) const;
-	void setVec3(const char* name, const glm::vec3& v) const;
+
+	const std::vector<UniformInfo>& uniforms() const { return uniform_table; }
+	const std::vector<BlockInfo>& blocks() const { return block_table; }
+	const BlockInfo* block(std::string_view name) const;
+	// -1 when the program has no such active uniform, which every setter ignores.
+	GLint location(UniformName name) const;
+	template <typename T>
+	Uniform<T> uniform(UniformName name) const {
+		return Uniform<T> {typed_location(name, gl_uniform_type<T>)};
+	}
+
+	void set(Uniform<bool> uniform, bool v) const;
+	void set(Uniform<int> uniform, int v) const;
+	void set(Uniform<unsigned> uniform, unsigned v) const;
+	void set(Uniform<float> uniform, float v) const;
+	void set(Uniform<glm::vec2> uniform, const glm::vec2& v) const;
+	void set(Uniform<glm::vec3> uniform, const glm::vec3& v) const;
+	void set(Uniform<glm::uvec3> uniform, const glm::uvec3& v) const;
+	void set(Uniform<glm::mat3> uniform, const glm::mat3& v) const;
+	void set(Uniform<glm::mat4> uniform, const glm::mat4& v) const;
+
+	// Setters by name go through the reflected table, not glGetUniformLocation.
+	void setBool(UniformName name, bool v) const;
+	void setFloat(UniformName name, float v) const;
+	void setInt(UniformName name, int v) const;
+	void setUint(UniformName name, unsigned v) const;
+	void setMat4(UniformName name, float* v) const;
+	void setMat4(UniformName name, const glm::mat4&) const;
+	void setMat3(UniformName name, const glm::mat3&) const;
+	void setMat3(UniformName name, float* v) const;
+	void setVec3(UniformName name, float v1, float v2, float v3) const;
+	void setVec3(UniformName name, const glm::vec3& v) const;
 	Shader(Shader&& other) noexcept;
 	Shader& operator=(Shader&& other) noexcept;
 	~Shader() noexcept;
 
 private:
+	// Open addressed, hash 0 marks an empty slot
+	struct Slot {
+		uint64_t hash;
+		GLint location;
+		GLenum type;
+	};
+
 	Shader(GLuint id);
 	Shader(const Shader&) = delete;
 	Shader& operator=(const Shader&) = delete;
 	static std::expected<void, std::string> checkCompileErrors(unsigned int shader, std::string type);
+	void reflect();
+	void insert(UniformName name, GLint location, GLenum type);
+	const Slot* find(UniformName name) const;
+	GLint typed_location(UniformName name, GLenum type) const;
+
+	std::vector<UniformInfo> uniform_table;
+	std::vector<BlockInfo> block_table;
+	std::vector<Slot> slots;
 };
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
+#include "vertex.hpp"
+
+// Quadric error metric edge-collapse simplifier (Garland & Heckbert 1997). Vertices only
+// ever collapse onto other existing vertices, so the result indexes the same vertex buffer
+// and LOD levels can share it. Attribute seams and open borders are kept in place.
+//
+// Collapses cheapest-first until the index count reaches `target_index_count` or the next
+// collapse would move geometry further than `target_error` (object space units).
+// `result_error` receives the largest error actually introduced.
+std::vector<GLuint> simplify(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t target_index_count,
+    float target_error,
+    float* result_error = nullptr
+);
+
+struct LodLevel {
+	std::vector<GLuint> indices;
+	float error; // object space, see simplify()
+};
+
+// Successively halved levels below the full mesh, coarsest last. Stops early once a
+// level no longer gets meaningfully smaller than the one before it.
+std::vector<LodLevel> build_lod_chain(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t max_levels = 4
+);
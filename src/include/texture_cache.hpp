@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <glad/gl.h>
+#include "ktx2.hpp"
+#include "mesh_cache.hpp"
+
+// One GL texture object, deleted together with its last reference.
+class GLTexture {
+public:
+	GLTexture(GLuint id, size_t bytes, int width, int height, int levels, GLenum internal_format);
+	~GLTexture() noexcept;
+	GLuint id;
+	size_t bytes;
+	int width;
+	int height;
+	int levels;
+	GLenum internal_format;
+	// Resident ARB_bindless_texture handle once MaterialTable asked for one, otherwise 0
+	uint64_t bindless_handle = 0;
+
+private:
+	GLTexture(const GLTexture&) = delete;
+	GLTexture& operator=(const GLTexture&) = delete;
+};
+
+// Process-wide texture cache keyed by resolved path and pixel content hash, so meshes and
+// separate Models referencing the same image share one GL texture. GL thread only.
+class TextureCache {
+public:
+	struct Stats {
+		size_t hits;
+		size_t misses;
+		size_t live_textures;
+		size_t bytes_uploaded;
+		size_t bytes_saved;
+	};
+
+	static TextureCache& shared();
+	std::shared_ptr<GLTexture> acquire(const ImageView& image);
+	Stats stats() const;
+
+private:
+	struct Key {
+		std::string path;
+		uint64_t hash;
+		bool operator==(const Key&) const = default;
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const {
+			return std::hash<std::string> {}(key.path) ^ key.hash;
+		}
+	};
+
+	static std::shared_ptr<GLTexture> upload(const ImageView& image);
+	// Uploads every level of a KTX2 image into texture `id`, which has to be bound.
+	static std::shared_ptr<GLTexture> upload_compressed(GLuint id, const Ktx2View& image);
+	std::unordered_map<Key, std::weak_ptr<GLTexture>, KeyHash> entries;
+	// Size at which acquire sweeps out expired entries
+	size_t sweep_size = 64;
+	Stats counters {};
+};
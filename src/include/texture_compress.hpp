@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
+
+// S3TC is an extension format, the core-profile loader doesn't define it.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum class BlockFormat : uint32_t {
+	BC1, // opaque rgb, 8 bytes per 4x4 block
+	BC3, // rgb + smooth alpha, 16 bytes
+	BC5, // two independent channels (normal maps), 16 bytes
+	BC7, // high quality rgba (mode 6 only), 16 bytes
+};
+
+// Block-compressed texture with its full mip chain, level 0 first.
+struct CompressedImage {
+	BlockFormat format;
+	int width;
+	int height;
+	std::vector<std::vector<uint8_t>> levels;
+};
+
+size_t block_bytes(BlockFormat format);
+GLenum gl_internal_format(BlockFormat format);
+
+// BC1/BC3 by alpha content, BC5 for two channel data and normal maps, BC7 for colour when
+// `high_quality` is set.
+BlockFormat pick_block_format(
+    std::span<const uint8_t> pixels,
+    int channels,
+    bool is_normal_map,
+    bool high_quality
+);
+
+// Expands one BC1 or BC3 level back to rgba8, for drivers without S3TC. Empty for other
+// formats or when `blocks` is too short for `width` x `height`.
+std::vector<uint8_t> decompress_level(
+    BlockFormat format,
+    std::span<const uint8_t> blocks,
+    int width,
+    int height
+);
+
+// Builds a box-filtered mip chain down to 1x1 and encodes every level.
+CompressedImage compress_image(
+    std::span<const uint8_t> pixels,
+    int width,
+    int height,
+    int channels,
+    BlockFormat format
+);
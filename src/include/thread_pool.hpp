@@ -0,0 +1,46 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads draining a FIFO job queue.
+class ThreadPool {
+public:
+	ThreadPool(size_t threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	template <typename F>
+	std::future<std::invoke_result_t<F>> submit(F job) {
+		// std::function needs a copyable callable, so the task lives behind a shared_ptr
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(job));
+		auto future = task->get_future();
+		{
+			std::lock_guard lock(mutex);
+			jobs.push([task] { (*task)(); });
+		}
+		cv.notify_one();
+		return future;
+	}
+	size_t size() const { return workers.size(); }
+
+	// Process-wide pool used for asset loading.
+	static ThreadPool& shared();
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	void work();
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool stopping = false;
+};
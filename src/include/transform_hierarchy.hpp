@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/ext/matrix_float3x3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+
+// One node of an imported transform tree, parents come before their children.
+struct SceneNode {
+	glm::mat4 local;
+	uint32_t parent; // TransformHierarchy::no_parent for roots
+	uint32_t padding[3];
+};
+static_assert(sizeof(SceneNode) == 80);
+
+// Scene graph as flat arrays indexed by node, parents always before their children so one
+// forward pass sees every parent's world matrix before its children need it. set_local only
+// marks a node dirty; update() recomputes world and normal matrices for dirty nodes and
+// everything below them, and leaves the rest alone.
+class TransformHierarchy {
+public:
+	static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+
+	// `parent` has to exist already, which keeps the arrays in topological order.
+	uint32_t add(const glm::mat4& local, uint32_t parent = no_parent);
+	void set_local(uint32_t node, const glm::mat4& local);
+	void clear();
+	// Brings every world and normal matrix up to date, returns how many were recomputed.
+	size_t update();
+
+	size_t size() const { return parents.size(); }
+	uint32_t parent(uint32_t node) const { return parents[node]; }
+	const glm::mat4& local(uint32_t node) const { return locals[node]; }
+	// As of the last update()
+	const glm::mat4& world(uint32_t node) const { return worlds[node]; }
+	// Inverse transpose of the world matrix's upper 3x3, for normals
+	const glm::mat3& normal_matrix(uint32_t node) const { return normals[node]; }
+
+private:
+	std::vector<uint32_t> parents;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<glm::mat3> normals;
+	// Set by set_local, spread to descendants and cleared by update()
+	std::vector<uint8_t> dirty;
+	// Nodes before this one are clean, update() starts here
+	size_t first_dirty = std::numeric_limits<size_t>::max();
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/ext/vector_float2.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <cstdint>
+
+struct Vertex {
+	glm::vec3 pos;
+	glm::vec3 normal;
+	glm::vec2 tex_coords;
+};
+
+enum class VertexFormat {
+	Full, // Vertex as is, 32 bytes
+	Compact, // CompactVertex, 16 bytes
+};
+
+// Vertex quantized for fetch bandwidth, decoded in the vertex shader.
+struct CompactVertex {
+	uint16_t pos[4]; // unorm16 across the mesh bounds (Mesh::pos_offset/pos_scale), w unused
+	int16_t normal[2]; // snorm16 octahedral encoding
+	uint16_t tex_coords[2]; // half floats
+};
+static_assert(sizeof(CompactVertex) == 16);
@@ -0,0 +1,134 @@
+#include "indirect_draws.hpp"
+#include <algorithm>
+#include "geometry_pool.hpp"
+#include "material_table.hpp"
+#include "mesh.hpp"
+
+int compare_geometry(const Mesh& a, uint32_t a_page, const Mesh& b, uint32_t b_page) {
+	if (a.format != b.format) return a.format < b.format ? -1 : 1;
+	if (a_page != b_page) return a_page < b_page ? -1 : 1;
+	if (a.index_type != b.index_type) return a.index_type < b.index_type ? -1 : 1;
+	return 0;
+}
+
+int compare_state(const Mesh& a, uint32_t a_page, const Mesh& b, uint32_t b_page) {
+	if (auto order = compare_geometry(a, a_page, b, b_page)) return order;
+	// Draws index the material table themselves
+	if (MaterialTable::shared().active()) return 0;
+	auto order = std::lexicographical_compare_three_way(
+	    a.textures.begin(),
+	    a.textures.end(),
+	    b.textures.begin(),
+	    b.textures.end(),
+	    [](const Texture& x, const Texture& y) { return x.id <=> y.id; }
+	);
+	return order < 0 ? -1 : order > 0 ? 1 : 0;
+}
+
+uint32_t IndirectDraws::add_draw(const DrawData& data) {
+	if (draws.size() >= max_draws) return max_draws;
+	draws.push_back(data);
+	return draws.size() - 1;
+}
+
+void IndirectDraws::add_command(const Mesh& mesh, uint32_t page, const DrawCommand& command) {
+	if (command.base_instance >= draws.size()) return;
+	entries.push_back(Entry {&mesh, page, command});
+}
+
+bool IndirectDraws::upload() {
+	if (uploaded) return !entries.empty();
+	uploaded = true;
+	last_stats = {.draws = draws.size(), .commands = entries.size()};
+	if (entries.empty()) return false;
+
+	std::ranges::stable_sort(entries, [](const Entry& a, const Entry& b) {
+		return compare_state(*a.mesh, a.page, *b.mesh, b.page) < 0;
+	});
+	commands.clear();
+	for (const auto& entry: entries) commands.push_back(entry.command);
+
+	if (!draw_buffer) {
+		glGenBuffers(1, &draw_buffer);
+		glGenBuffers(1, &command_buffer);
+	}
+	// Orphaned every frame so the driver never waits on last frame's draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_buffer);
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    draws.size() * sizeof(DrawData),
+	    draws.data(),
+	    GL_STREAM_DRAW
+	);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+	glBufferData(
+	    GL_DRAW_INDIRECT_BUFFER,
+	    commands.size() * sizeof(DrawCommand),
+	    commands.data(),
+	    GL_STREAM_DRAW
+	);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	return true;
+}
+
+void IndirectDraws::submit(const Shader& shader) {
+	if (!upload()) return;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, draw_buffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+	for (size_t start = 0; start < entries.size();) {
+		const auto& first = entries[start];
+		size_t end = start + 1;
+		for (; end < entries.size(); end++) {
+			const auto& next = entries[end];
+			if (compare_state(*first.mesh, first.page, *next.mesh, next.page) != 0) break;
+		}
+
+		first.mesh->bind_textures(shader);
+		GeometryPool::shared(first.mesh->format).bind(first.page);
+		glMultiDrawElementsIndirect(
+		    GL_TRIANGLES,
+		    first.mesh->index_type,
+		    (void*) (start * sizeof(DrawCommand)),
+		    (GLsizei) (end - start),
+		    0
+		);
+		last_stats.batches++;
+		start = end;
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDraws::submit_positions() {
+	if (!upload()) return;
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, draw_buffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+	// Entries are sorted by geometry first, so equal geometry is still contiguous
+	for (size_t start = 0; start < entries.size();) {
+		const auto& first = entries[start];
+		size_t end = start + 1;
+		for (; end < entries.size(); end++) {
+			const auto& next = entries[end];
+			if (compare_geometry(*first.mesh, first.page, *next.mesh, next.page) != 0) break;
+		}
+
+		GeometryPool::shared(first.mesh->format).bind_positions(first.page);
+		glMultiDrawElementsIndirect(
+		    GL_TRIANGLES,
+		    first.mesh->index_type,
+		    (void*) (start * sizeof(DrawCommand)),
+		    (GLsizei) (end - start),
+		    0
+		);
+		last_stats.position_batches++;
+		start = end;
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDraws::clear() {
+	draws.clear();
+	entries.clear();
+	uploaded = false;
+}
@@ -0,0 +1,28 @@
+#include "instance_buffer.hpp"
+#include <algorithm>
+
+void InstanceBuffer::add(const glm::mat4& model, glm::vec3 color) {
+	instances.push_back(InstanceData {model, glm::vec4(color, 1.f)});
+	dirty = true;
+}
+
+void InstanceBuffer::clear() {
+	instances.clear();
+	dirty = true;
+}
+
+void InstanceBuffer::bind() {
+	if (!buffer) glGenBuffers(1, &buffer);
+	if (dirty) {
+		// Orphaned like IndirectDraws' buffers, last frame's draws may still read the old one
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(
+		    GL_SHADER_STORAGE_BUFFER,
+		    std::max<size_t>(instances.size(), 1) * sizeof(InstanceData),
+		    instances.empty() ? nullptr : instances.data(),
+		    GL_STREAM_DRAW
+		);
+		dirty = false;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer_binding, buffer);
+}
@@ -0,0 +1,149 @@
+#include "ktx2.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace {
+constexpr uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Header {
+	uint8_t identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t layer_count;
+	uint32_t face_count;
+	uint32_t level_count;
+	uint32_t supercompression_scheme;
+	uint32_t dfd_byte_offset;
+	uint32_t dfd_byte_length;
+	uint32_t kvd_byte_offset;
+	uint32_t kvd_byte_length;
+	uint64_t sgd_byte_offset;
+	uint64_t sgd_byte_length;
+};
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex {
+	uint64_t byte_offset;
+	uint64_t byte_length;
+	uint64_t uncompressed_byte_length;
+};
+
+// VkFormat values of the *_UNORM_BLOCK formats.
+uint32_t vk_format(BlockFormat format) {
+	switch (format) {
+	case BlockFormat::BC1: return 131;
+	case BlockFormat::BC3: return 137;
+	case BlockFormat::BC5: return 141;
+	case BlockFormat::BC7: return 145;
+	}
+	return 0;
+}
+
+// Basic data format descriptor: one sample per stored channel of the 4x4 block.
+std::vector<uint32_t> data_format_descriptor(BlockFormat format) {
+	// khr_df_model_e and channel ids for the BC models
+	uint32_t model = 0;
+	std::vector<std::pair<uint32_t, uint32_t>> samples; // channel id, bit offset
+	switch (format) {
+	case BlockFormat::BC1: model = 128, samples = {{0, 0}}; break;
+	case BlockFormat::BC3: model = 130, samples = {{15, 0}, {0, 64}}; break;
+	case BlockFormat::BC5: model = 132, samples = {{0, 0}, {1, 64}}; break;
+	case BlockFormat::BC7: model = 134, samples = {{0, 0}}; break;
+	}
+	uint32_t bits = block_bytes(format) * 8 / samples.size();
+	uint32_t block_size = 24 + 16 * samples.size();
+
+	std::vector<uint32_t> dfd = {
+	    4 + block_size,
+	    0,                       // vendor 0 (Khronos), descriptor type 0 (basic)
+	    2 | (block_size << 16),  // version 2
+	    model | (1 << 8) | (1 << 16), // bt709 primaries, linear transfer, straight alpha
+	    3 | (3 << 8),            // 4x4x1x1 texel block, stored minus one
+	    (uint32_t) block_bytes(format),
+	    0,
+	};
+	for (auto [channel, offset]: samples) {
+		dfd.push_back(offset | ((bits - 1) << 16) | (channel << 24));
+		dfd.push_back(0);
+		dfd.push_back(0);
+		dfd.push_back(UINT32_MAX);
+	}
+	return dfd;
+}
+} // namespace
+
+std::vector<uint8_t> write_ktx2(const CompressedImage& image) {
+	auto dfd = data_format_descriptor(image.format);
+	uint32_t level_count = image.levels.size();
+
+	Header header {};
+	std::memcpy(header.identifier, identifier, sizeof(identifier));
+	header.vk_format = vk_format(image.format);
+	header.type_size = 1;
+	header.pixel_width = image.width;
+	header.pixel_height = image.height;
+	header.face_count = 1;
+	header.level_count = level_count;
+	header.dfd_byte_offset = sizeof(Header) + level_count * sizeof(LevelIndex);
+	header.dfd_byte_length = dfd.size() * sizeof(uint32_t);
+
+	std::vector<uint8_t> out(header.dfd_byte_offset + header.dfd_byte_length);
+	std::vector<LevelIndex> levels(level_count);
+	// Level data is stored smallest mip first, each aligned to the block size
+	size_t align = block_bytes(image.format);
+	for (size_t i = level_count; i-- > 0;) {
+		out.resize((out.size() + align - 1) / align * align);
+		levels[i] = LevelIndex {
+		    .byte_offset = out.size(),
+		    .byte_length = image.levels[i].size(),
+		    .uncompressed_byte_length = image.levels[i].size(),
+		};
+		out.insert(out.end(), image.levels[i].begin(), image.levels[i].end());
+	}
+
+	std::memcpy(out.data(), &header, sizeof(header));
+	std::memcpy(out.data() + sizeof(Header), levels.data(), levels.size() * sizeof(LevelIndex));
+	std::memcpy(out.data() + header.dfd_byte_offset, dfd.data(), header.dfd_byte_length);
+	return out;
+}
+
+std::expected<Ktx2View, std::string> parse_ktx2(std::span<const uint8_t> bytes) {
+	Header header;
+	if (bytes.size() < sizeof(header)) return std::unexpected("KTX2: truncated header");
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (std::memcmp(header.identifier, identifier, sizeof(identifier)) != 0) {
+		return std::unexpected("KTX2: bad identifier");
+	}
+	if (header.supercompression_scheme != 0 || header.pixel_depth > 1 || header.layer_count > 1
+	    || header.face_count != 1) {
+		return std::unexpected("KTX2: only plain 2D textures are supported");
+	}
+
+	Ktx2View view {.width = (int) header.pixel_width, .height = (int) header.pixel_height};
+	bool known = false;
+	for (auto format: {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5, BlockFormat::BC7}) {
+		if (vk_format(format) == header.vk_format) {
+			view.format = format;
+			known = true;
+		}
+	}
+	if (!known) return std::unexpected(std::format("KTX2: unsupported vkFormat {}", header.vk_format));
+
+	uint32_t level_count = std::max(header.level_count, 1u);
+	if (bytes.size() < sizeof(Header) + level_count * sizeof(LevelIndex)) {
+		return std::unexpected("KTX2: truncated level index");
+	}
+	for (uint32_t i = 0; i < level_count; i++) {
+		LevelIndex level;
+		std::memcpy(&level, bytes.data() + sizeof(Header) + i * sizeof(LevelIndex), sizeof(level));
+		if (level.byte_offset > bytes.size() || level.byte_length > bytes.size() - level.byte_offset) {
+			return std::unexpected("KTX2: level out of bounds");
+		}
+		view.levels.push_back(bytes.subspan(level.byte_offset, level.byte_length));
+	}
+	return view;
+}
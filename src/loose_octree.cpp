@@ -0,0 +1,226 @@
+#include "loose_octree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+
+LooseOctree::LooseOctree(glm::vec3 center, float half_size, uint32_t max_depth)
+    : root_center(center)
+    , root_half_size(half_size)
+    , max_depth(max_depth) {
+	clear();
+}
+
+void LooseOctree::clear() {
+	nodes.clear();
+	free_nodes.clear();
+	objects.clear();
+	free_handles.clear();
+	Node root {.parent = none, .depth = 0, .cell = glm::uvec3(0), .center = root_center};
+	std::ranges::fill(root.children, none);
+	root.loose_half_size = root_half_size * 2.f;
+	nodes.push_back(std::move(root));
+}
+
+void LooseOctree::locate(glm::vec3 center, float radius, uint32_t& depth, glm::uvec3& cell)
+    const {
+	depth = 0;
+	cell = glm::uvec3(0);
+	auto local = center - (root_center - root_half_size);
+	float root_size = root_half_size * 2.f;
+	bool outside = glm::any(glm::lessThan(local, glm::vec3(0.f)))
+	            || glm::any(glm::greaterThanEqual(local, glm::vec3(root_size)));
+	if (outside || radius > root_half_size) return;
+
+	float half_size = root_half_size;
+	while (depth < max_depth && radius <= half_size * 0.5f) {
+		half_size *= 0.5f;
+		depth++;
+	}
+	auto cells = (float) (1u << depth);
+	cell = glm::uvec3(glm::clamp(local / root_size * cells, glm::vec3(0.f), glm::vec3(cells - 1.f)));
+}
+
+int32_t LooseOctree::find_or_create(uint32_t depth, glm::uvec3 cell) {
+	int32_t node = 0;
+	for (uint32_t level = 0; level < depth; level++) {
+		auto shift = depth - level - 1;
+		auto bits = (cell >> shift) & 1u;
+		auto child = bits.x | bits.y << 1 | bits.z << 2;
+		if (nodes[node].children[child] != none) {
+			node = nodes[node].children[child];
+			continue;
+		}
+
+		int32_t index;
+		if (!free_nodes.empty()) {
+			index = free_nodes.back();
+			free_nodes.pop_back();
+		} else {
+			index = (int32_t) nodes.size();
+			nodes.emplace_back();
+		}
+		auto child_cell = cell >> shift;
+		float half_size = root_half_size / (float) (1u << (level + 1));
+		auto& created = nodes[index];
+		created.parent = node;
+		std::ranges::fill(created.children, none);
+		created.depth = level + 1;
+		created.cell = child_cell;
+		created.center =
+		    root_center - root_half_size + (glm::vec3(child_cell) * 2.f + 1.f) * half_size;
+		created.loose_half_size = half_size * 2.f;
+		created.objects.clear();
+		nodes[node].children[child] = index;
+		node = index;
+	}
+	return node;
+}
+
+void LooseOctree::link(Handle handle, int32_t node) {
+	auto& object = objects[handle];
+	object.node = node;
+	object.slot = (uint32_t) nodes[node].objects.size();
+	nodes[node].objects.push_back(handle);
+}
+
+void LooseOctree::unlink(Handle handle) {
+	auto& object = objects[handle];
+	auto& list = nodes[object.node].objects;
+	auto moved = list.back();
+	list[object.slot] = moved;
+	objects[moved].slot = object.slot;
+	list.pop_back();
+	prune(object.node);
+	object.node = none;
+}
+
+void LooseOctree::prune(int32_t node) {
+	// Empty leaves go back to the free list, then their parents if that empties them too
+	while (node != 0 && nodes[node].objects.empty()
+	       && std::ranges::all_of(nodes[node].children, [](int32_t c) { return c == none; })) {
+		auto parent = nodes[node].parent;
+		std::ranges::replace(nodes[parent].children, node, none);
+		free_nodes.push_back(node);
+		node = parent;
+	}
+}
+
+LooseOctree::Handle LooseOctree::insert(glm::vec3 center, float radius, uint32_t value) {
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	} else {
+		handle = (Handle) objects.size();
+		objects.emplace_back();
+	}
+	objects[handle] = Object {.center = center, .radius = radius, .value = value};
+
+	uint32_t depth;
+	glm::uvec3 cell;
+	locate(center, radius, depth, cell);
+	link(handle, find_or_create(depth, cell));
+	return handle;
+}
+
+void LooseOctree::move(Handle handle, glm::vec3 center, float radius) {
+	auto& object = objects[handle];
+	object.center = center;
+	object.radius = radius;
+
+	uint32_t depth;
+	glm::uvec3 cell;
+	locate(center, radius, depth, cell);
+	const auto& node = nodes[object.node];
+	if (node.depth == depth && node.cell == cell) return;
+	unlink(handle);
+	link(handle, find_or_create(depth, cell));
+}
+
+void LooseOctree::remove(Handle handle) {
+	unlink(handle);
+	free_handles.push_back(handle);
+}
+
+void LooseOctree::collect(int32_t node, std::vector<uint32_t>& out) const {
+	for (auto handle: nodes[node].objects) out.push_back(objects[handle].value);
+	for (auto child: nodes[node].children) {
+		if (child != none) collect(child, out);
+	}
+}
+
+void LooseOctree::query(const Frustum& frustum, std::vector<uint32_t>& out) const {
+	query_node(0, frustum, out);
+}
+
+void LooseOctree::query_node(int32_t index, const Frustum& frustum, std::vector<uint32_t>& out)
+    const {
+	const auto& node = nodes[index];
+	// The root holds whatever didn't fit its cell, so only the objects get tested there
+	if (index != 0) {
+		bool inside = true;
+		for (const auto& plane: frustum.planes) {
+			auto normal = glm::vec3(plane);
+			float distance = glm::dot(normal, node.center) + plane.w;
+			float reach = node.loose_half_size * glm::dot(glm::abs(normal), glm::vec3(1.f));
+			if (distance + reach < 0.f) return;
+			inside &= distance - reach >= 0.f;
+		}
+		// Every object lies within the loose bounds, nothing below needs testing
+		if (inside) return collect(index, out);
+	}
+
+	for (auto handle: node.objects) {
+		const auto& object = objects[handle];
+		bool visible = true;
+		for (const auto& plane: frustum.planes) {
+			visible &= glm::dot(glm::vec3(plane), object.center) + plane.w >= -object.radius;
+		}
+		if (visible) out.push_back(object.value);
+	}
+	for (auto child: node.children) {
+		if (child != none) query_node(child, frustum, out);
+	}
+}
+
+void LooseOctree::query(glm::vec3 center, float radius, std::vector<uint32_t>& out) const {
+	query_node(0, center, radius, out);
+}
+
+void LooseOctree::query_node(
+    int32_t index,
+    glm::vec3 center,
+    float radius,
+    std::vector<uint32_t>& out
+) const {
+	const auto& node = nodes[index];
+	if (index != 0) {
+		auto closest = glm::clamp(
+		    center,
+		    node.center - node.loose_half_size,
+		    node.center + node.loose_half_size
+		);
+		auto offset = closest - center;
+		if (glm::dot(offset, offset) > radius * radius) return;
+	}
+
+	for (auto handle: node.objects) {
+		const auto& object = objects[handle];
+		auto offset = object.center - center;
+		float reach = object.radius + radius;
+		if (glm::dot(offset, offset) <= reach * reach) out.push_back(object.value);
+	}
+	for (auto child: node.children) {
+		if (child != none) query_node(child, center, radius, out);
+	}
+}
+
+LooseOctree::Stats LooseOctree::stats() const {
+	return Stats {
+	    .objects = size(),
+	    .nodes = nodes.size() - free_nodes.size(),
+	    .root_objects = nodes[0].objects.size(),
+	};
+}
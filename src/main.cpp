@@ -1,6 +1,17 @@
 #include "app.hpp"
+#include "bench.hpp"
+#include "tools.hpp"
 #include <print>
-int main() {
+#include <span>
+#include <string_view>
+int main(int argc, char** argv) {
+	auto args = std::span(argv, argc);
+	if (args.size() > 1) {
+		std::string_view command = args[1];
+		if (command == "bench") return run_benchmark(args.subspan(2));
+		if (command == "tool") return run_tool(args.subspan(2));
+	}
+
 	auto app_res = App::create();
 	if (!app_res) {
 		std::println("[APP_ERROR]: {}", app_res.error());
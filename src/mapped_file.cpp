@@ -0,0 +1,62 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(void* data, size_t size): data(data), size(size) {}
+
+MappedFile::~MappedFile() noexcept {
+	if (data) munmap(data, size);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, nullptr))
+    , size(std::exchange(other.size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		if (data) munmap(data, size);
+		data = std::exchange(other.data, nullptr);
+		size = std::exchange(other.size, 0);
+	}
+	return *this;
+}
+
+std::expected<MappedFile, std::string> MappedFile::open(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return std::unexpected(std::format("{}: {}", path, std::strerror(errno)));
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		auto err = std::format("{}: {}", path, std::strerror(errno));
+		::close(fd);
+		return std::unexpected(err);
+	}
+	// mmap refuses zero-length mappings, an empty file is just an empty span
+	if (st.st_size == 0) {
+		::close(fd);
+		return MappedFile(nullptr, 0);
+	}
+
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) return std::unexpected(std::format("{}: {}", path, std::strerror(errno)));
+
+	return MappedFile(data, st.st_size);
+}
+
+std::span<const uint8_t> MappedFile::bytes() const { return {(const uint8_t*) data, size}; }
+
+uint64_t hash_bytes(std::span<const uint8_t> bytes) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (auto b: bytes) {
+		hash ^= b;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
@@ -0,0 +1,252 @@
+#include "material_table.hpp"
+#include <algorithm>
+#include <GLFW/glfw3.h>
+#include "mesh.hpp"
+#include "texture_cache.hpp"
+
+namespace {
+// glad is generated without extensions, so ARB_bindless_texture is loaded by hand
+using GetTextureHandle = GLuint64(GLAD_API_PTR*)(GLuint texture);
+using SetHandleResidency = void(GLAD_API_PTR*)(GLuint64 handle);
+GetTextureHandle get_texture_handle = nullptr;
+SetHandleResidency make_handle_resident = nullptr;
+SetHandleResidency make_handle_non_resident = nullptr;
+
+constexpr uint32_t no_array = 0xffffffff;
+} // namespace
+
+GLuint MaterialTable::bound_program = 0;
+
+MaterialSlot::MaterialSlot(MaterialTable& table, uint32_t index): table(table), index(index) {}
+MaterialSlot::~MaterialSlot() noexcept { table.release(index); }
+
+MaterialTable& MaterialTable::shared() {
+	// Leaked like GeometryPool, meshes may outlive static destruction
+	static auto* table = new MaterialTable;
+	return *table;
+}
+
+bool MaterialTable::bindless_supported() {
+	static bool supported = [] {
+		if (!glfwExtensionSupported("GL_ARB_bindless_texture")) return false;
+		get_texture_handle = (GetTextureHandle) glfwGetProcAddress("glGetTextureHandleARB");
+		make_handle_resident =
+		    (SetHandleResidency) glfwGetProcAddress("glMakeTextureHandleResidentARB");
+		make_handle_non_resident =
+		    (SetHandleResidency) glfwGetProcAddress("glMakeTextureHandleNonResidentARB");
+		return get_texture_handle && make_handle_resident && make_handle_non_resident;
+	}();
+	return supported;
+}
+
+void MaterialTable::release_handle(uint64_t handle) {
+	if (make_handle_non_resident) make_handle_non_resident(handle);
+}
+
+std::expected<void, std::string> MaterialTable::set_mode(MaterialMode mode) {
+	if (mode == MaterialMode::Bindless && !bindless_supported()) {
+		return std::unexpected("GL_ARB_bindless_texture is not supported");
+	}
+	if (mode != MaterialMode::TextureArray && !arrays.empty()) {
+		glDeleteTextures(arrays.size(), arrays.data());
+		arrays.clear();
+		layers.clear();
+	}
+	current = mode;
+	dirty = true;
+	arrays_dirty = true;
+	bound_program = 0;
+	return {};
+}
+
+std::shared_ptr<MaterialSlot> MaterialTable::acquire(std::span<const Texture> textures) {
+	Entry entry;
+	for (const auto& texture: textures) {
+		if (!texture.handle) continue;
+		if (texture.type == "texture_diffuse") entry.diffuse.push_back(texture.handle);
+		if (texture.type == "texture_specular") entry.specular.push_back(texture.handle);
+	}
+	for (const auto& texture: entry.diffuse) entry.key.push_back(texture->id);
+	entry.key.push_back(0);
+	for (const auto& texture: entry.specular) entry.key.push_back(texture->id);
+
+	if (auto it = lookup.find(entry.key); it != lookup.end()) {
+		if (auto slot = entries[it->second].slot.lock()) return slot;
+	}
+
+	uint32_t index = entries.size();
+	if (!free_indices.empty()) {
+		index = free_indices.back();
+		free_indices.pop_back();
+	} else {
+		entries.emplace_back();
+	}
+	auto slot = std::make_shared<MaterialSlot>(*this, index);
+	entry.slot = slot;
+	lookup[entry.key] = index;
+	entries[index] = std::move(entry);
+	dirty = true;
+	arrays_dirty = true;
+	return slot;
+}
+
+void MaterialTable::release(uint32_t index) {
+	auto& entry = entries[index];
+	if (auto it = lookup.find(entry.key); it != lookup.end() && it->second == index) {
+		lookup.erase(it);
+	}
+	entry = Entry {};
+	free_indices.push_back(index);
+	dirty = true;
+	arrays_dirty = true;
+}
+
+void MaterialTable::encode(GLTexture& texture, uint32_t (&out)[2]) {
+	if (current == MaterialMode::Bindless) {
+		if (!texture.bindless_handle) {
+			texture.bindless_handle = get_texture_handle(texture.id);
+			make_handle_resident(texture.bindless_handle);
+		}
+		out[0] = (uint32_t) texture.bindless_handle;
+		out[1] = (uint32_t) (texture.bindless_handle >> 32);
+		return;
+	}
+	auto it = layers.find(texture.id);
+	out[0] = it != layers.end() ? it->second.array : no_array;
+	out[1] = it != layers.end() ? it->second.layer : 0;
+}
+
+void MaterialTable::build_arrays() {
+	glDeleteTextures(arrays.size(), arrays.data());
+	arrays.clear();
+	layers.clear();
+	counters.array_layers = counters.array_bytes = counters.overflow = 0;
+
+	std::map<ArrayKey, std::vector<GLTexture*>> groups;
+	for (const auto& entry: entries) {
+		for (const auto* list: {&entry.diffuse, &entry.specular}) {
+			for (const auto& texture: *list) {
+				auto key = ArrayKey {
+				    texture->width,
+				    texture->height,
+				    texture->levels,
+				    texture->internal_format,
+				};
+				auto& group = groups[key];
+				if (std::ranges::find(group, texture.get()) == group.end()) {
+					group.push_back(texture.get());
+				}
+			}
+		}
+	}
+	// The largest groups get the few arrays there are
+	std::vector<std::pair<ArrayKey, std::vector<GLTexture*>>> sorted(groups.begin(), groups.end());
+	std::ranges::stable_sort(sorted, [](const auto& a, const auto& b) {
+		return a.second.size() > b.second.size();
+	});
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	for (const auto& [key, textures]: sorted) {
+		auto count = std::min<size_t>(textures.size(), max_layers);
+		if (arrays.size() == max_arrays) count = 0;
+		counters.overflow += textures.size() - count;
+		if (count == 0) continue;
+
+		GLuint array;
+		glGenTextures(1, &array);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		glTexStorage3D(
+		    GL_TEXTURE_2D_ARRAY,
+		    key.levels,
+		    key.internal_format,
+		    key.width,
+		    key.height,
+		    count
+		);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		for (uint32_t layer = 0; layer < count; layer++) {
+			for (int level = 0; level < key.levels; level++) {
+				glCopyImageSubData(
+				    textures[layer]->id,
+				    GL_TEXTURE_2D,
+				    level,
+				    0,
+				    0,
+				    0,
+				    array,
+				    GL_TEXTURE_2D_ARRAY,
+				    level,
+				    0,
+				    0,
+				    layer,
+				    std::max(key.width >> level, 1),
+				    std::max(key.height >> level, 1),
+				    1
+				);
+			}
+			layers[textures[layer]->id] = Layer {(uint32_t) arrays.size(), layer};
+			counters.array_bytes += textures[layer]->bytes;
+		}
+		counters.array_layers += count;
+		arrays.push_back(array);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	arrays_dirty = false;
+}
+
+void MaterialTable::upload() {
+	if (current == MaterialMode::TextureArray && arrays_dirty) build_arrays();
+
+	records.assign(entries.size(), MaterialRecord {});
+	for (size_t i = 0; i < entries.size(); i++) {
+		auto& record = records[i];
+		const auto& entry = entries[i];
+		record.diff_number = std::min(entry.diffuse.size(), max_textures);
+		record.spec_number = std::min(entry.specular.size(), max_textures);
+		for (int t = 0; t < record.diff_number; t++) encode(*entry.diffuse[t], record.diffuse[t]);
+		for (int t = 0; t < record.spec_number; t++) encode(*entry.specular[t], record.specular[t]);
+	}
+
+	if (!buffer) glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	// Never empty, binding a zero sized buffer range is an error
+	glBufferData(
+	    GL_SHADER_STORAGE_BUFFER,
+	    std::max<size_t>(records.size(), 1) * sizeof(MaterialRecord),
+	    records.empty() ? nullptr : records.data(),
+	    GL_DYNAMIC_DRAW
+	);
+	counters.uploads++;
+	dirty = false;
+	bound_program = 0;
+}
+
+void MaterialTable::bind(const Shader& shader) {
+	if (dirty) upload();
+	if (shader.id == bound_program) return;
+	bound_program = shader.id;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer_binding, buffer);
+	if (current != MaterialMode::TextureArray) return;
+	// Every array sampler gets its own unit, even unused ones can't alias another type
+	for (size_t i = 0; i < max_arrays; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, i < arrays.size() ? arrays[i] : 0);
+		shader.setInt(UniformName("material_arrays").at(i), i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void MaterialTable::reset_binding() { bound_program = 0; }
+
+MaterialTable::Stats MaterialTable::stats() const {
+	auto stats = counters;
+	stats.materials = entries.size() - free_indices.size();
+	stats.arrays = arrays.size();
+	return stats;
+}
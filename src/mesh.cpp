@@ -4,53 +4,180 @@
 #include <string>
 #include <vector>
 #include <format>
+#include <cmath>
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
 #include <mesh.hpp>
+#include "geometry_pool.hpp"
+#include "gpu_scene.hpp"
+#include "indirect_draws.hpp"
+#include "material_table.hpp"
 #include "shader.hpp"
 
+namespace {
+// Octahedral normal encoding, folded into [-1, 1]^2.
+glm::vec2 encode_octahedral(glm::vec3 n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	// Collapsed triangles leave zero normals, which would divide into NaN. (0, 0, 1) instead
+	if (!(l1 > 0.f) || !std::isfinite(l1)) return glm::vec2(0.f);
+	n /= l1;
+	if (n.z >= 0.f) return glm::vec2(n.x, n.y);
+	return glm::vec2(
+	    (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+	    (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f)
+	);
+}
+
+int16_t to_snorm16(float v) { return (int16_t) std::lround(std::clamp(v, -1.f, 1.f) * 32767.f); }
+
+std::vector<CompactVertex>
+compact_vertices(std::span<const Vertex> vertices, glm::vec3& pos_offset, glm::vec3& pos_scale) {
+	glm::vec3 lo(0.f), hi(0.f);
+	if (!vertices.empty()) lo = hi = vertices[0].pos;
+	for (const auto& vert: vertices) {
+		lo = glm::min(lo, vert.pos);
+		hi = glm::max(hi, vert.pos);
+	}
+	pos_offset = lo;
+	pos_scale = hi - lo;
+
+	std::vector<CompactVertex> out(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const auto& vert = vertices[i];
+		auto& compact = out[i];
+		for (int c = 0; c < 3; c++) {
+			float t = pos_scale[c] > 0.f ? (vert.pos[c] - lo[c]) / pos_scale[c] : 0.f;
+			compact.pos[c] = (uint16_t) std::lround(std::clamp(t, 0.f, 1.f) * 65535.f);
+		}
+		compact.pos[3] = 0;
+		auto normal = encode_octahedral(vert.normal);
+		compact.normal[0] = to_snorm16(normal.x);
+		compact.normal[1] = to_snorm16(normal.y);
+		compact.tex_coords[0] = glm::packHalf1x16(vert.tex_coords.x);
+		compact.tex_coords[1] = glm::packHalf1x16(vert.tex_coords.y);
+	}
+	return out;
+}
+
+// Narrows indices to 16 bits. Meshes over 65536 vertices are cut into triangle runs whose
+// vertex window fits, each rebased with base_vertex. Returns false if that would take so
+// many runs that 32 bit indices are the better deal.
+bool narrow_indices(
+    std::span<const GLuint> indices,
+    size_t vertex_count,
+    std::vector<uint16_t>& narrow,
+    std::vector<IndexRange>& ranges
+) {
+	constexpr GLuint window = 1 << 16;
+	size_t max_ranges = vertex_count / (window / 4) + 1;
+
+	size_t start = 0;
+	GLuint lo = ~0u, hi = 0;
+	auto flush = [&](size_t end) {
+		ranges.push_back(IndexRange {
+		    .count = (GLsizei) (end - start),
+		    .offset = narrow.size() * sizeof(uint16_t),
+		    .base_vertex = (GLint) lo,
+		});
+		for (size_t i = start; i < end; i++) narrow.push_back(indices[i] - lo);
+		start = end;
+		lo = ~0u;
+		hi = 0;
+	};
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		auto tri_lo = std::min({indices[t], indices[t + 1], indices[t + 2]});
+		auto tri_hi = std::max({indices[t], indices[t + 1], indices[t + 2]});
+		if (tri_hi - tri_lo >= window) return false;
+		if (t > start && std::max(hi, tri_hi) - std::min(lo, tri_lo) >= window) {
+			flush(t);
+			if (ranges.size() >= max_ranges) return false;
+		}
+		lo = std::min(lo, tri_lo);
+		hi = std::max(hi, tri_hi);
+	}
+	if (start < indices.size()) flush(indices.size());
+	return true;
+}
+} // namespace
+
 Mesh::Mesh(
-    std::vector<Vertex> verts,
-    std::vector<unsigned int> indicies,
-    std::vector<Texture> textures
+    std::span<const Vertex> vertices,
+    std::span<const GLuint> indices,
+    std::vector<Texture> textures,
+    const Bounds& bounds,
+    VertexFormat format,
+    std::span<const LodView> lod_levels,
+    std::span<const Meshlet> meshlets
 )
-    : vertices(std::move(verts))
-    , indices(std::move(indicies))
-    , textures(std::move(textures)) {
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, pos));
-
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, normal));
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(
-	    GL_ELEMENT_ARRAY_BUFFER,
-	    indices.size() * sizeof(unsigned int),
-	    indices.data(),
-	    GL_STATIC_DRAW
-	);
+    : bounds(bounds)
+    , format(format)
+    , pos_offset(0.f)
+    , pos_scale(1.f)
+    , textures(std::move(textures))
+    , meshlets(meshlets.begin(), meshlets.end()) {
+	std::vector<CompactVertex> compact;
+	auto vertex_bytes = std::as_bytes(vertices);
+	if (format == VertexFormat::Compact) {
+		compact = compact_vertices(vertices, pos_offset, pos_scale);
+		vertex_bytes = std::as_bytes(std::span<const CompactVertex>(compact));
+	}
 
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(
-	    2,
-	    2,
-	    GL_FLOAT,
-	    GL_FALSE,
-	    sizeof(Vertex),
-	    (void*) offsetof(Vertex, tex_coords)
-	);
+	lods.push_back(Lod {.index_count = (GLsizei) indices.size(), .error = 0.f});
+	for (const auto& level: lod_levels) {
+		lods.push_back(Lod {.index_count = (GLsizei) level.indices.size(), .error = level.error});
+	}
+	auto level_indices = [&](size_t level) {
+		return level == 0 ? indices : lod_levels[level - 1].indices;
+	};
+
+	std::vector<uint16_t> narrow;
+	std::vector<GLuint> wide;
+	bool narrowed = true;
+	for (size_t level = 0; level < lods.size() && narrowed; level++) {
+		narrowed = narrow_indices(
+		    level_indices(level),
+		    vertices.size(),
+		    narrow,
+		    lods[level].index_ranges
+		);
+	}
+	auto index_bytes = std::as_bytes(std::span<const uint16_t>(narrow));
+	if (narrowed) {
+		index_type = GL_UNSIGNED_SHORT;
+	} else {
+		index_type = GL_UNSIGNED_INT;
+		for (size_t level = 0; level < lods.size(); level++) {
+			auto& lod = lods[level];
+			lod.index_ranges = {IndexRange {
+			    .count = lod.index_count,
+			    .offset = wide.size() * sizeof(GLuint),
+			    .base_vertex = 0,
+			}};
+			auto level_span = level_indices(level);
+			wide.insert(wide.end(), level_span.begin(), level_span.end());
+		}
+		index_bytes = std::as_bytes(std::span<const GLuint>(wide));
+	}
 
-	glBindVertexArray(0);
+	geometry = GeometryPool::shared(format).allocate(
+	    {(const uint8_t*) vertex_bytes.data(), vertex_bytes.size()},
+	    vertices.size(),
+	    {(const uint8_t*) index_bytes.data(), index_bytes.size()}
+	);
+	material = MaterialTable::shared().acquire(this->textures);
 }
-void Mesh::draw(const Shader& shader) const {
+
+uint32_t Mesh::material_index() const { return material->index; }
+
+void Mesh::bind_textures(const Shader& shader) const {
+	auto& table = MaterialTable::shared();
+	if (table.active()) {
+		table.bind(shader);
+		shader.setUint("material_index", material->index);
+		return;
+	}
+
 	uint32_t diff_num = 0;
 	uint32_t spec_num = 0;
 	std::string name;
@@ -65,15 +192,164 @@ void Mesh::draw(const Shader& shader) const {
 			number = spec_num++;
 		}
 
-		std::string uniform_name = std::format("material.{}[{}]", name, number);
-		shader.setInt(uniform_name.c_str(), i);
+		shader.setInt(UniformName("material").member(name).at(number), i);
 		glBindTexture(GL_TEXTURE_2D, textures[i].id);
 	}
 	shader.setInt("material.diff_number", diff_num);
 	shader.setInt("material.spec_number", spec_num);
 	glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::bind_geometry(const Shader& shader) const {
+	shader.setBool("compact_vertices", format == VertexFormat::Compact);
+	shader.setVec3("pos_offset", pos_offset);
+	shader.setVec3("pos_scale", pos_scale);
+	GeometryPool::shared(format).bind(geometry->page);
+}
 
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+void Mesh::bind_positions(const Shader& shader) const {
+	shader.setVec3("pos_offset", pos_offset);
+	shader.setVec3("pos_scale", pos_scale);
+	GeometryPool::shared(format).bind_positions(geometry->page);
+}
+
+uint32_t Mesh::page() const { return geometry->page; }
+
+size_t Mesh::index_size() const {
+	return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+}
+
+template <typename F>
+void Mesh::for_each_range(bool meshlets_only, std::span<const uint32_t> visible, F&& fn) const {
+	size_t index_base = geometry->index_offset / index_size();
+	auto vertex_base = (GLint) geometry->first_vertex;
+	if (!meshlets_only) {
+		for (const auto& range: lods[lod].index_ranges) {
+			fn(range.count, index_base + range.offset / index_size(), vertex_base + range.base_vertex);
+		}
+		return;
+	}
+
+	// Level 0 comes first in the mesh's index range, so index i of the full mesh sits at
+	// i * index_size(), and its ranges are sorted. Runs of adjacent meshlets become one draw,
+	// clipped to whichever 16 bit range each part falls in.
+	const auto& ranges = lods[0].index_ranges;
+	size_t range = 0;
+	for (size_t i = 0; i < visible.size();) {
+		size_t start = meshlets[visible[i]].index_offset;
+		size_t end = start + meshlets[visible[i]].index_count;
+		for (i++; i < visible.size() && meshlets[visible[i]].index_offset == end; i++) {
+			end += meshlets[visible[i]].index_count;
+		}
+		for (; range < ranges.size(); range++) {
+			size_t range_start = ranges[range].offset / index_size();
+			size_t range_end = range_start + ranges[range].count;
+			if (range_end <= start) continue;
+			if (range_start >= end) break;
+			size_t first = std::max(start, range_start);
+			fn((GLsizei) (std::min(end, range_end) - first),
+			   index_base + first,
+			   vertex_base + ranges[range].base_vertex);
+			if (range_end > end) break;
+		}
+	}
+}
+
+void Mesh::draw(const Shader& shader) const {
+	bind_textures(shader);
+	bind_geometry(shader);
+	draw_bound();
+}
+
+void Mesh::draw_bound() const {
+	for_each_range(false, {}, [&](GLsizei count, size_t first, GLint base_vertex) {
+		glDrawElementsBaseVertex(
+		    GL_TRIANGLES,
+		    count,
+		    index_type,
+		    (void*) (first * index_size()),
+		    base_vertex
+		);
+	});
+}
+
+void Mesh::draw_instanced(const Shader& shader, GLsizei instance_count) const {
+	bind_textures(shader);
+	bind_geometry(shader);
+	for_each_range(false, {}, [&](GLsizei count, size_t first, GLint base_vertex) {
+		glDrawElementsInstancedBaseVertex(
+		    GL_TRIANGLES,
+		    count,
+		    index_type,
+		    (void*) (first * index_size()),
+		    instance_count,
+		    base_vertex
+		);
+	});
+}
+
+void Mesh::draw_meshlets(const Shader& shader, std::span<const uint32_t> visible) const {
+	bind_textures(shader);
+	bind_geometry(shader);
+	draw_bound(visible);
+}
+
+void Mesh::draw_bound(std::span<const uint32_t> visible) const {
+	for_each_range(true, visible, [&](GLsizei count, size_t first, GLint base_vertex) {
+		glDrawElementsBaseVertex(
+		    GL_TRIANGLES,
+		    count,
+		    index_type,
+		    (void*) (first * index_size()),
+		    base_vertex
+		);
+	});
+}
+
+void Mesh::queue(IndirectDraws& draws, uint32_t draw_id) const {
+	for_each_range(false, {}, [&](GLsizei count, size_t first, GLint base_vertex) {
+		draws.add_command(
+		    *this,
+		    geometry->page,
+		    DrawCommand {(GLuint) count, 1, (GLuint) first, base_vertex, draw_id}
+		);
+	});
+}
+
+void Mesh::queue(GpuScene& scene, uint32_t draw_id) const {
+	for_each_range(false, {}, [&](GLsizei count, size_t first, GLint base_vertex) {
+		scene.add_command(
+		    *this,
+		    geometry->page,
+		    DrawCommand {(GLuint) count, 1, (GLuint) first, base_vertex, draw_id}
+		);
+	});
+}
+
+void Mesh::queue_meshlets(
+    IndirectDraws& draws,
+    uint32_t draw_id,
+    std::span<const uint32_t> visible
+) const {
+	for_each_range(true, visible, [&](GLsizei count, size_t first, GLint base_vertex) {
+		draws.add_command(
+		    *this,
+		    geometry->page,
+		    DrawCommand {(GLuint) count, 1, (GLuint) first, base_vertex, draw_id}
+		);
+	});
+}
+void Mesh::select_lod(float pixels_per_unit, float threshold) {
+	auto fits = [&](size_t level, float limit) {
+		return lods[level].error * pixels_per_unit <= limit;
+	};
+	size_t target = 0;
+	while (target + 1 < lods.size() && fits(target + 1, threshold)) target++;
+
+	// Refining happens right away, coarsening only once the next level clears the margin
+	if (target < lod) {
+		lod = target;
+	} else {
+		while (lod < target && fits(lod + 1, threshold * lod_hysteresis)) lod++;
+	}
 }
@@ -0,0 +1,268 @@
+#include "mesh_cache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <type_traits>
+#include <utility>
+
+namespace {
+constexpr char magic[8] = {'G', 'L', 'M', 'C', 'A', 'C', 'H', 'E'};
+// Every blob starts on this boundary so views into the mapping are properly aligned.
+constexpr uint64_t blob_alignment = 16;
+
+struct Range {
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertex_size;
+	CacheKey key;
+	uint32_t mesh_count;
+	uint32_t image_count;
+	Range nodes;
+};
+
+struct MeshRecord {
+	Range vertices;
+	Range indices;
+	Range textures;
+	Range lods;
+	Range meshlets;
+	Bounds bounds;
+	uint32_t node;
+	uint32_t padding;
+};
+
+struct LodRecord {
+	Range indices;
+	float error;
+	uint32_t padding;
+};
+
+struct ImageRecord {
+	Range type;
+	Range path;
+	int32_t width;
+	int32_t height;
+	int32_t channels;
+	ImageEncoding encoding;
+	Range pixels;
+};
+
+static_assert(std::is_trivially_copyable_v<Vertex>);
+static_assert(std::is_trivially_copyable_v<Meshlet>);
+static_assert(std::is_trivially_copyable_v<Bounds>);
+static_assert(std::is_trivially_copyable_v<SceneNode>);
+
+class Writer {
+public:
+	uint64_t offset = 0;
+	std::ofstream out;
+
+	void raw(const void* data, uint64_t size) {
+		out.write((const char*) data, size);
+		offset += size;
+	}
+	void pad() {
+		static constexpr char zeros[blob_alignment] = {};
+		raw(zeros, (blob_alignment - offset % blob_alignment) % blob_alignment);
+	}
+	template <typename T>
+	Range blob(std::span<const T> data) {
+		pad();
+		Range range {.offset = offset, .count = data.size()};
+		raw(data.data(), data.size_bytes());
+		return range;
+	}
+};
+
+template <typename T>
+std::expected<std::span<const T>, std::string>
+view(std::span<const uint8_t> file, const Range& range) {
+	if (range.offset % alignof(T) != 0 || range.offset > file.size()
+	    || range.count > (file.size() - range.offset) / sizeof(T))
+		return std::unexpected("Range out of bounds");
+	return std::span<const T>((const T*) (file.data() + range.offset), range.count);
+}
+
+// Nothing checks indices on the GPU, one past the vertices reads whatever follows them
+bool indices_in_range(std::span<const GLuint> indices, size_t vertex_count) {
+	return std::ranges::all_of(indices, [&](GLuint index) { return index < vertex_count; });
+}
+
+// glTexImage2D reads width * height * channels bytes of raw pixels, no matter what is there
+bool pixels_match(const ImageRecord& record, std::span<const uint8_t> pixels) {
+	if (record.encoding != ImageEncoding::Raw) return true;
+	if (record.width <= 0 || record.height <= 0 || record.channels < 1 || record.channels > 4) {
+		return false;
+	}
+	return pixels.size() == (uint64_t) record.width * record.height * record.channels;
+}
+} // namespace
+
+MeshCache::MeshCache(MappedFile file): file(std::move(file)) {}
+
+std::expected<MeshCache, std::string>
+MeshCache::open(const std::string& path, const CacheKey& key) {
+	auto mapped = MappedFile::open(path);
+	if (!mapped) return std::unexpected(mapped.error());
+	auto bytes = mapped->bytes();
+
+	if (bytes.size() < sizeof(FileHeader)) return std::unexpected("Truncated header");
+	FileHeader header;
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) return std::unexpected("Bad magic");
+	if (header.version != version || header.vertex_size != sizeof(Vertex)) {
+		return std::unexpected(std::format("Version {} is stale", header.version));
+	}
+	if (header.key.source_hash != key.source_hash) return std::unexpected("Source file changed");
+	if (header.key != key) return std::unexpected("Import options changed");
+
+	auto cache = MeshCache(std::move(*mapped));
+	auto nodes = view<SceneNode>(bytes, header.nodes);
+	if (!nodes) return std::unexpected(nodes.error());
+	for (size_t i = 0; i < nodes->size(); i++) {
+		auto parent = (*nodes)[i].parent;
+		if (parent != TransformHierarchy::no_parent && parent >= i) {
+			return std::unexpected("Corrupt node order");
+		}
+	}
+	cache.nodes = *nodes;
+
+	auto mesh_records = view<MeshRecord>(bytes, {sizeof(FileHeader), header.mesh_count});
+	if (!mesh_records) return std::unexpected(mesh_records.error());
+	auto image_records = view<ImageRecord>(
+	    bytes,
+	    {sizeof(FileHeader) + mesh_records->size_bytes(), header.image_count}
+	);
+	if (!image_records) return std::unexpected(image_records.error());
+
+	for (const auto& record: *mesh_records) {
+		auto vertices = view<Vertex>(bytes, record.vertices);
+		auto indices = view<GLuint>(bytes, record.indices);
+		auto textures = view<uint32_t>(bytes, record.textures);
+		auto lods = view<LodRecord>(bytes, record.lods);
+		auto meshlets = view<Meshlet>(bytes, record.meshlets);
+		if (!vertices || !indices || !textures || !lods || !meshlets
+		    || !indices_in_range(*indices, vertices->size())) {
+			return std::unexpected("Corrupt mesh record");
+		}
+		if (record.node >= nodes->size()) return std::unexpected("Corrupt node reference");
+		for (auto texture: *textures) {
+			if (texture >= header.image_count) return std::unexpected("Corrupt texture reference");
+		}
+		for (const auto& meshlet: *meshlets) {
+			if ((uint64_t) meshlet.index_offset + meshlet.index_count > indices->size()) {
+				return std::unexpected("Corrupt meshlet");
+			}
+		}
+		auto& mesh = cache.meshes.emplace_back(MeshView {*vertices, *indices, *textures});
+		mesh.meshlets = *meshlets;
+		mesh.bounds = record.bounds;
+		mesh.node = record.node;
+		for (const auto& lod: *lods) {
+			auto lod_indices = view<GLuint>(bytes, lod.indices);
+			if (!lod_indices) return std::unexpected("Corrupt LOD record");
+			if (!indices_in_range(*lod_indices, vertices->size())) {
+				return std::unexpected("Corrupt mesh record");
+			}
+			mesh.lods.push_back(LodView {*lod_indices, lod.error});
+		}
+	}
+	for (const auto& record: *image_records) {
+		auto type = view<char>(bytes, record.type);
+		auto path = view<char>(bytes, record.path);
+		auto pixels = view<uint8_t>(bytes, record.pixels);
+		if (!type || !path || !pixels || !pixels_match(record, *pixels)) {
+			return std::unexpected("Corrupt image record");
+		}
+		cache.images.push_back(ImageView {
+		    .type = {type->data(), type->size()},
+		    .path = {path->data(), path->size()},
+		    .width = record.width,
+		    .height = record.height,
+		    .channels = record.channels,
+		    .encoding = record.encoding,
+		    .pixels = *pixels,
+		});
+	}
+
+	return cache;
+}
+
+std::expected<void, std::string> MeshCache::write(
+    const std::string& path,
+    const CacheKey& key,
+    std::span<const MeshView> meshes,
+    std::span<const ImageView> images,
+    std::span<const SceneNode> nodes
+) {
+	// Write next to the target and rename over it, so a crash never leaves a torn cache.
+	auto tmp_path = path + ".tmp";
+	Writer writer;
+	writer.out.open(tmp_path, std::ios::binary | std::ios::trunc);
+	if (!writer.out.good()) return std::unexpected(std::format("Failed to open {}", tmp_path));
+
+	FileHeader header {
+	    .version = version,
+	    .vertex_size = sizeof(Vertex),
+	    .key = key,
+	    .mesh_count = (uint32_t) meshes.size(),
+	    .image_count = (uint32_t) images.size(),
+	};
+	std::memcpy(header.magic, magic, sizeof(magic));
+
+	// Header and records are patched in once the blob offsets are known.
+	std::vector<MeshRecord> mesh_records(meshes.size());
+	std::vector<ImageRecord> image_records(images.size());
+	writer.raw(&header, sizeof(header));
+	writer.raw(mesh_records.data(), mesh_records.size() * sizeof(MeshRecord));
+	writer.raw(image_records.data(), image_records.size() * sizeof(ImageRecord));
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		std::vector<LodRecord> lod_records;
+		for (const auto& lod: meshes[i].lods) {
+			lod_records.push_back(LodRecord {.indices = writer.blob(lod.indices), .error = lod.error});
+		}
+		mesh_records[i] = MeshRecord {
+		    .vertices = writer.blob(meshes[i].vertices),
+		    .indices = writer.blob(meshes[i].indices),
+		    .textures = writer.blob(meshes[i].textures),
+		    .lods = writer.blob(std::span<const LodRecord>(lod_records)),
+		    .meshlets = writer.blob(meshes[i].meshlets),
+		    .bounds = meshes[i].bounds,
+		    .node = meshes[i].node,
+		};
+	}
+	for (size_t i = 0; i < images.size(); i++) {
+		const auto& image = images[i];
+		image_records[i] = ImageRecord {
+		    .type = writer.blob(std::span(image.type)),
+		    .path = writer.blob(std::span(image.path)),
+		    .width = image.width,
+		    .height = image.height,
+		    .channels = image.channels,
+		    .encoding = image.encoding,
+		    .pixels = writer.blob(image.pixels),
+		};
+	}
+
+	header.nodes = writer.blob(nodes);
+
+	writer.out.seekp(0);
+	writer.out.write((const char*) &header, sizeof(header));
+	writer.out.write((const char*) mesh_records.data(), mesh_records.size() * sizeof(MeshRecord));
+	writer.out.write((const char*) image_records.data(), image_records.size() * sizeof(ImageRecord));
+	writer.out.close();
+	if (!writer.out.good()) return std::unexpected(std::format("Failed to write {}", tmp_path));
+
+	std::error_code err;
+	std::filesystem::rename(tmp_path, path, err);
+	if (err) return std::unexpected(std::format("Failed to rename {}: {}", tmp_path, err.message()));
+	return {};
+}
@@ -0,0 +1,220 @@
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <numeric>
+#include <glm/geometric.hpp>
+
+namespace {
+// FIFO post-transform cache, timestamps make lookups O(1).
+class FifoCache {
+public:
+	FifoCache(size_t vertex_count, size_t size): stamps(vertex_count, 0), size(size) {}
+
+	// True if `v` had to be transformed.
+	bool access(GLuint v) {
+		if (stamps[v] != 0 && time - stamps[v] < size) return false;
+		stamps[v] = ++time;
+		return true;
+	}
+	void flush() { time += size; }
+
+private:
+	std::vector<size_t> stamps;
+	size_t size;
+	size_t time = 0;
+};
+
+// Triangles referencing each vertex, as offsets into one flat array.
+struct Adjacency {
+	std::vector<GLuint> offsets;
+	std::vector<GLuint> triangles;
+
+	Adjacency(std::span<const GLuint> indices, size_t vertex_count)
+	    : offsets(vertex_count + 1, 0)
+	    , triangles(indices.size()) {
+		for (auto v: indices) offsets[v + 1]++;
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+		std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) triangles[fill[indices[i]]++] = i / 3;
+	}
+	std::span<const GLuint> of(GLuint v) const {
+		return std::span(triangles).subspan(offsets[v], offsets[v + 1] - offsets[v]);
+	}
+};
+} // namespace
+
+VertexCacheStats
+analyze_vertex_cache(std::span<const GLuint> indices, size_t vertex_count, size_t cache_size) {
+	if (indices.empty()) return {0.f, 0.f};
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector<bool> used(vertex_count, false);
+	size_t misses = 0, unique = 0;
+	for (auto v: indices) {
+		misses += cache.access(v);
+		if (!used[v]) {
+			used[v] = true;
+			unique++;
+		}
+	}
+	return {(float) misses / (indices.size() / 3), (float) misses / unique};
+}
+
+std::vector<GLuint>
+optimize_vertex_cache(std::span<const GLuint> indices, size_t vertex_count, size_t cache_size) {
+	size_t triangle_count = indices.size() / 3;
+	Adjacency adjacency(indices, vertex_count);
+
+	std::vector<GLuint> live(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++) live[v] = adjacency.of(v).size();
+	std::vector<size_t> stamps(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<GLuint> dead_end;
+	std::vector<GLuint> candidates;
+	std::vector<GLuint> out;
+	out.reserve(indices.size());
+
+	size_t time = cache_size + 1;
+	size_t cursor = 0;
+	int64_t fan = vertex_count ? 0 : -1;
+	while (fan >= 0) {
+		candidates.clear();
+		for (auto t: adjacency.of(fan)) {
+			if (emitted[t]) continue;
+			for (size_t k = 0; k < 3; k++) {
+				auto v = indices[t * 3 + k];
+				out.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamps[v] > cache_size) stamps[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Prefer the candidate whose remaining triangles still fit in the cache, oldest first
+		fan = -1;
+		int64_t best = -1;
+		for (auto v: candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - stamps[v] + 2 * live[v] <= cache_size) priority = time - stamps[v];
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+		if (fan >= 0) continue;
+
+		// Dead end: fall back to recently used vertices, then to input order
+		while (!dead_end.empty() && fan < 0) {
+			auto v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) fan = v;
+		}
+		while (cursor < vertex_count && fan < 0) {
+			if (live[cursor] > 0) fan = cursor;
+			cursor++;
+		}
+	}
+	return out;
+}
+
+std::vector<GLuint> optimize_overdraw(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    float threshold,
+    size_t cache_size
+) {
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) return {indices.begin(), indices.end()};
+
+	// Hard boundaries are where the cache is flushed anyway (all three vertices miss). Soft
+	// ones split those further wherever a cluster drawn from a cold cache would still stay
+	// within `threshold` of the mesh's ACMR, so reordering clusters costs little reuse.
+	std::vector<size_t> clusters;
+	{
+		FifoCache cache(vertices.size(), cache_size);
+		std::vector<bool> hard(triangle_count, false);
+		size_t total_misses = 0;
+		for (size_t t = 0; t < triangle_count; t++) {
+			size_t misses = 0;
+			for (size_t k = 0; k < 3; k++) misses += cache.access(indices[t * 3 + k]);
+			hard[t] = misses == 3;
+			total_misses += misses;
+		}
+		float target = (float) total_misses / triangle_count * threshold;
+
+		cache.flush();
+		size_t start = 0, running = 0;
+		clusters.push_back(0);
+		for (size_t t = 0; t < triangle_count; t++) {
+			if (t > start && hard[t]) {
+				clusters.push_back(t);
+				cache.flush();
+				start = t;
+				running = 0;
+			}
+			for (size_t k = 0; k < 3; k++) running += cache.access(indices[t * 3 + k]);
+			if (t + 1 < triangle_count && (float) running / (t - start + 1) <= target) {
+				clusters.push_back(t + 1);
+				cache.flush();
+				start = t + 1;
+				running = 0;
+			}
+		}
+		clusters.push_back(triangle_count);
+	}
+
+	glm::vec3 mesh_center(0.f);
+	for (const auto& vert: vertices) mesh_center += vert.pos;
+	mesh_center /= (float) std::max<size_t>(vertices.size(), 1);
+
+	// Clusters far out along their own normal tend to occlude the rest, draw them first
+	size_t cluster_count = clusters.size() - 1;
+	std::vector<float> keys(cluster_count);
+	for (size_t c = 0; c < cluster_count; c++) {
+		glm::vec3 centroid(0.f), normal(0.f);
+		float area = 0.f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			auto a = vertices[indices[t * 3]].pos;
+			auto b = vertices[indices[t * 3 + 1]].pos;
+			auto d = vertices[indices[t * 3 + 2]].pos;
+			auto n = glm::cross(b - a, d - a);
+			float tri_area = glm::length(n);
+			centroid += (a + b + d) * (tri_area / 3.f);
+			normal += n;
+			area += tri_area;
+		}
+		if (area > 0.f) centroid /= area;
+		float normal_length = glm::length(normal);
+		keys[c] = normal_length > 0.f ? glm::dot(centroid - mesh_center, normal / normal_length) : 0.f;
+	}
+
+	std::vector<size_t> order(cluster_count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return keys[a] > keys[b];
+	});
+
+	std::vector<GLuint> out;
+	out.reserve(indices.size());
+	for (auto c: order) {
+		out.insert(out.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	return out;
+}
+
+void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+	constexpr GLuint unused = ~0u;
+	std::vector<GLuint> remap(vertices.size(), unused);
+	std::vector<Vertex> out;
+	out.reserve(vertices.size());
+	for (auto& index: indices) {
+		if (remap[index] == unused) {
+			remap[index] = out.size();
+			out.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(out);
+}
@@ -0,0 +1,124 @@
+#include "meshlet.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include "culling.hpp"
+
+namespace {
+Meshlet
+meshlet_bounds(std::span<const GLuint> indices, std::span<const Vertex> vertices, uint32_t offset) {
+	Meshlet meshlet {.index_offset = offset, .index_count = (uint32_t) indices.size()};
+
+	glm::vec3 lo = vertices[indices[0]].pos, hi = lo;
+	for (auto index: indices) {
+		lo = glm::min(lo, vertices[index].pos);
+		hi = glm::max(hi, vertices[index].pos);
+	}
+	meshlet.center = (lo + hi) * 0.5f;
+	meshlet.radius = 0.f;
+	for (auto index: indices) {
+		meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[index].pos));
+	}
+
+	// Cone around the average face normal, widened to the most divergent triangle
+	std::vector<glm::vec3> normals;
+	glm::vec3 axis(0.f);
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		auto p0 = vertices[indices[t]].pos;
+		auto n = glm::cross(vertices[indices[t + 1]].pos - p0, vertices[indices[t + 2]].pos - p0);
+		float len = glm::length(n);
+		if (len == 0.f) continue;
+		normals.push_back(n / len);
+		axis += normals.back();
+	}
+	float axis_len = glm::length(axis);
+	float min_dot = 1.f;
+	if (axis_len > 0.f) {
+		axis /= axis_len;
+		for (auto n: normals) min_dot = std::min(min_dot, glm::dot(axis, n));
+	}
+	// Past ~84 degrees the cone culls next to nothing, so don't pay for the test
+	if (axis_len == 0.f || min_dot <= 0.1f) {
+		meshlet.cone_axis = glm::vec3(0.f);
+		meshlet.cone_cutoff = 1.f;
+	} else {
+		// The backfacing region is the normal cone widened by 90 degrees and flipped,
+		// cos(angle + 90) negated is sin(angle)
+		meshlet.cone_axis = axis;
+		meshlet.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+	}
+	return meshlet;
+}
+} // namespace
+
+std::vector<Meshlet> build_meshlets(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t max_vertices,
+    size_t max_triangles
+) {
+	std::vector<Meshlet> meshlets;
+	// Which meshlet last used each vertex, so membership checks are O(1)
+	std::vector<uint32_t> seen(vertices.size(), ~0u);
+	size_t start = 0, vertex_count = 0;
+
+	auto flush = [&](size_t end) {
+		meshlets.push_back(meshlet_bounds(indices.subspan(start, end - start), vertices, start));
+		start = end;
+		vertex_count = 0;
+	};
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		auto id = (uint32_t) meshlets.size();
+		size_t added = 0;
+		for (size_t k = 0; k < 3; k++) added += seen[indices[t + k]] != id;
+		if (t > start && (vertex_count + added > max_vertices || (t - start) / 3 >= max_triangles)) {
+			flush(t);
+			id++;
+		}
+		for (size_t k = 0; k < 3; k++) {
+			if (seen[indices[t + k]] != id) {
+				seen[indices[t + k]] = id;
+				vertex_count++;
+			}
+		}
+	}
+	size_t end = indices.size() / 3 * 3;
+	if (start < end) flush(end);
+	return meshlets;
+}
+
+ClusterCullView
+ClusterCullView::create(const glm::mat4& model_view_projection, glm::vec3 camera_pos) {
+	return ClusterCullView {
+	    .planes = Frustum::from_matrix(model_view_projection).planes,
+	    .camera_pos = camera_pos,
+	};
+}
+
+void cull_meshlets(
+    std::span<const Meshlet> meshlets,
+    const ClusterCullView& view,
+    std::vector<uint32_t>& visible,
+    ClusterCullStats& stats
+) {
+	stats.tested += meshlets.size();
+	for (uint32_t i = 0; i < meshlets.size(); i++) {
+		const auto& meshlet = meshlets[i];
+		bool outside = false;
+		for (const auto& plane: view.planes) {
+			outside |= glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius;
+		}
+		if (outside) {
+			stats.frustum_culled++;
+			continue;
+		}
+		auto to_center = meshlet.center - view.camera_pos;
+		if (glm::dot(to_center, meshlet.cone_axis)
+		    >= meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius) {
+			stats.backface_culled++;
+			continue;
+		}
+		visible.push_back(i);
+	}
+}
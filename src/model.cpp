@@ -1,9 +1,23 @@
 #include "model.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
-#include <cstring>
+#include <filesystem>
+#include <glm/geometric.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/matrix.hpp>
 #include <vector>
+#include "indirect_draws.hpp"
+#include "ktx2.hpp"
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "meshlet.hpp"
 #include "shader.hpp"
+#include "simplifier.hpp"
+#include "texture_cache.hpp"
+#include "texture_compress.hpp"
+#include "thread_pool.hpp"
 #include <GL/gl.h>
 #include <assimp/Importer.hpp>
 #include <assimp/mesh.h>
@@ -12,61 +26,422 @@
 #include <assimp/types.h>
 #include <assimp/vector2.h>
 #include <format>
+#include <future>
 #include <print>
+#include <utility>
 #include <stb/image.h>
 
-Model::Model(std::vector<Mesh> meshes): meshes(std::move(meshes)) {}
+ImageView ImageData::view() const {
+	return ImageView {
+	    .type = type,
+	    .path = path,
+	    .width = width,
+	    .height = height,
+	    .channels = channels,
+	    .pixels = pixels,
+	};
+}
+
+MeshView MeshData::view() const {
+	MeshView view {vertices, indices, textures};
+	for (const auto& lod: lods) view.lods.push_back(LodView {lod.indices, lod.error});
+	view.meshlets = meshlets;
+	view.bounds = bounds;
+	view.node = node;
+	return view;
+}
+
+std::vector<MeshView> ModelData::mesh_views() const {
+	std::vector<MeshView> views;
+	for (const auto& mesh: meshes) views.push_back(mesh.view());
+	return views;
+}
+
+std::vector<ImageView> ModelData::image_views() const {
+	std::vector<ImageView> views;
+	for (const auto& image: images) views.push_back(image.view());
+	return views;
+}
+
+Model::Model(
+    std::vector<Mesh> meshes,
+    std::span<const SceneNode> nodes,
+    std::vector<uint32_t> mesh_nodes
+)
+    : meshes(std::move(meshes))
+    , mesh_nodes(std::move(mesh_nodes)) {
+	for (const auto& node: nodes) this->nodes.add(node.local, node.parent);
+	if (nodes.empty()) {
+		this->nodes.add(glm::mat4(1.f));
+		this->mesh_nodes.assign(this->meshes.size(), 0);
+	}
+	update_nodes();
+}
+
+void Model::update_nodes() {
+	if (nodes.update() == 0) return;
+	mesh_bounds.clear();
+	mesh_boxes.clear();
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const auto& bounds = mesh_bounds.emplace_back(
+		    meshes[i].bounds.transformed(nodes.world(mesh_nodes[i]))
+		);
+		mesh_boxes.add(bounds.min, bounds.max);
+	}
+}
+
+glm::mat4 Model::mesh_model(const DrawView& view, uint32_t index) const {
+	return view.model * nodes.world(mesh_nodes[index]);
+}
 
 void Model::draw(const Shader& shader) {
-	for (const auto& mesh: meshes) {
-		mesh.draw(shader);
+	update_nodes();
+	for (size_t i = 0; i < meshes.size(); i++) {
+		shader.setMat4("model", nodes.world(mesh_nodes[i]));
+		shader.setMat3("normalMatrix", nodes.normal_matrix(mesh_nodes[i]));
+		meshes[i].draw(shader);
+	}
+}
+
+void Model::draw_instanced(const Shader& shader, InstanceBuffer& instances) {
+	if (instances.size() == 0) return;
+	update_nodes();
+	instances.bind();
+	for (size_t i = 0; i < meshes.size(); i++) {
+		shader.setMat4("node", nodes.world(mesh_nodes[i]));
+		meshes[i].draw_instanced(shader, instances.size());
 	}
 }
 
-std::expected<Model, std::string> Model::create(const std::string& path) {
+void Model::select_lods(const DrawView& view) {
+	// Errors are in object space, scale them by the largest axis of the model matrix
+	float model_scale = std::max(
+	    {glm::length(glm::vec3(view.model[0])),
+	     glm::length(glm::vec3(view.model[1])),
+	     glm::length(glm::vec3(view.model[2]))}
+	);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		auto& mesh = meshes[i];
+		const auto& bounds = mesh_bounds[i];
+		// and by the node's, which the model space sphere was grown by
+		float scale = model_scale;
+		if (mesh.bounds.radius > 0.f) scale *= bounds.radius / mesh.bounds.radius;
+		auto center = glm::vec3(view.model * glm::vec4(bounds.center, 1.f));
+		// Distance to the bounding sphere rather than the center, so big meshes refine early
+		float distance = glm::distance(center, view.camera_pos) - bounds.radius * model_scale;
+		mesh.select_lod(
+		    view.projection_scale * scale / std::max(distance, 1e-3f),
+		    view.lod_threshold
+		);
+	}
+}
+
+void Model::cull_meshes(const DrawView& view) {
+	mesh_stats = {};
+	occlusion_stats = {};
+	visible_meshes.clear();
+	if (view.cull_meshes) {
+		// Planes in model space, so the boxes only move when their nodes do
+		auto frustum = Frustum::from_matrix(view.view_projection * view.model);
+		cull_boxes(frustum, mesh_boxes, visible_meshes, mesh_stats);
+	} else {
+		for (uint32_t i = 0; i < meshes.size(); i++) visible_meshes.push_back(i);
+	}
+	if (!view.occlusion || !view.occlusion->ready()) return;
+
+	size_t kept = 0;
+	for (auto index: visible_meshes) {
+		const auto& mesh = meshes[index];
+		occlusion_stats.tested++;
+		if (view.occlusion->occluded(mesh_bounds[index], view.model)) {
+			occlusion_stats.culled++;
+			occlusion_stats.culled_triangles += mesh.lods[mesh.lod].index_count / 3;
+		} else {
+			visible_meshes[kept++] = index;
+		}
+	}
+	visible_meshes.resize(kept);
+}
+
+void Model::enqueue(
+    RenderQueue& queue,
+    RenderQueue::Pass pass,
+    Shader& shader,
+    const DrawView& view
+) {
+	update_nodes();
+	select_lods(view);
+	cull_meshes(view);
+	cluster_stats = {};
+	for (auto index: visible_meshes) {
+		const auto& mesh = meshes[index];
+		auto model = mesh_model(view, index);
+		std::optional<std::span<const uint32_t>> visible;
+		if (cull_clusters(mesh, view, model)) visible = visible_meshlets;
+		queue.submit(pass, shader, mesh, model, visible);
+	}
+}
+
+bool Model::cull_clusters(const Mesh& mesh, const DrawView& view, const glm::mat4& model) {
+	if (!view.cull_clusters || mesh.lod != 0 || mesh.meshlets.empty()) return false;
+	auto cull_view = ClusterCullView::create(
+	    view.view_projection * model,
+	    glm::vec3(glm::inverse(model) * glm::vec4(view.camera_pos, 1.f))
+	);
+	visible_meshlets.clear();
+	cull_meshlets(mesh.meshlets, cull_view, visible_meshlets, cluster_stats);
+	return true;
+}
+
+void Model::draw(const Shader& shader, const DrawView& view) {
+	update_nodes();
+	select_lods(view);
+	cull_meshes(view);
+	cluster_stats = {};
+	// Node normal matrices are cached, only the model matrix's own one is computed per draw
+	auto view_normal = glm::transpose(glm::inverse(glm::mat3(view.model)));
+
+	for (auto index: visible_meshes) {
+		const auto& mesh = meshes[index];
+		auto model = mesh_model(view, index);
+		auto normal_matrix = view_normal * nodes.normal_matrix(mesh_nodes[index]);
+		bool culled = cull_clusters(mesh, view, model);
+		if (view.indirect) {
+			auto draw_id = view.indirect->add_draw(DrawData {
+			    .model = model,
+			    .normal_matrix = glm::mat4(normal_matrix),
+			    .pos_offset = glm::vec4(mesh.pos_offset, mesh.format == VertexFormat::Compact),
+			    .pos_scale = glm::vec4(mesh.pos_scale, 0.f),
+			    .material = mesh.material_index(),
+			});
+			if (culled) {
+				mesh.queue_meshlets(*view.indirect, draw_id, visible_meshlets);
+			} else {
+				mesh.queue(*view.indirect, draw_id);
+			}
+			continue;
+		}
+		shader.setMat4("model", model);
+		shader.setMat3("normalMatrix", normal_matrix);
+		if (culled) {
+			mesh.draw_meshlets(shader, visible_meshlets);
+		} else {
+			mesh.draw(shader);
+		}
+	}
+}
+
+void Model::add_instance(GpuScene& scene, const glm::mat4& transform) const {
+	auto transform_normal = glm::transpose(glm::inverse(glm::mat3(transform)));
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const auto& mesh = meshes[i];
+		auto node = mesh_nodes[i];
+		auto draw_id = scene.add_draw(
+		    DrawData {
+		        .model = transform * nodes.world(node),
+		        .normal_matrix = glm::mat4(transform_normal * nodes.normal_matrix(node)),
+		        .pos_offset = glm::vec4(mesh.pos_offset, mesh.format == VertexFormat::Compact),
+		        .pos_scale = glm::vec4(mesh.pos_scale, 0.f),
+		        .material = mesh.material_index(),
+		    },
+		    mesh.bounds
+		);
+		mesh.queue(scene, draw_id);
+	}
+}
+
+uint32_t ModelOptions::bake_options() const {
+	return (compress_textures ? 1 : 0) | (high_quality_textures ? 2 : 0)
+	     | (optimize_meshes ? 4 : 0) | (generate_lods ? 8 : 0) | (build_meshlets ? 16 : 0);
+}
+
+std::expected<Model, std::string> Model::create(const std::string& path, const ModelOptions& options) {
+	auto source = Model::load(path, options);
+	if (!source) return std::unexpected(source.error());
+	return Model::upload(*source, options);
+}
+
+std::expected<ModelSource, std::string>
+Model::load(const std::string& path, const ModelOptions& options) {
+	auto source = MappedFile::open(path);
+	if (!source) return std::unexpected(source.error());
+	auto key = CacheKey {
+	    .source_hash = hash_bytes(source->bytes()),
+	    .import_flags = import_flags,
+	    .bake_options = options.bake_options(),
+	};
+	auto cache_path = path + ".meshcache";
+
+	auto cache = MeshCache::open(cache_path, key);
+	if (cache) return std::move(*cache);
+	std::println("Mesh cache miss for {}: {}", path, cache.error());
+
+	auto data = Model::import(path, options, ThreadPool::shared());
+	if (!data) return std::unexpected(data.error());
+
+	auto written = MeshCache::write(
+	    cache_path,
+	    key,
+	    data->mesh_views(),
+	    data->image_views(),
+	    data->nodes
+	);
+	if (!written) std::println("Failed to write mesh cache: {}", written.error());
+
+	return std::move(*data);
+}
+
+std::expected<ModelData, std::string>
+Model::import(const std::string& path, const ModelOptions& options, ThreadPool& pool) {
 	Assimp::Importer importer;
-	const aiScene* scene =
-	    importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+	const aiScene* scene = importer.ReadFile(path, import_flags);
 
-	if (!scene || scene->mFlags * AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		return std::unexpected(std::format("Assimp Error: {}", importer.GetErrorString()));
 	}
 
-	std::vector<Mesh> meshes;
-	std::vector<Texture> textures_loaded;
+	ImportState state {.options = options};
 	auto dir = path.substr(0, path.find_last_of('/'));
 
-	Model::process_node(scene->mRootNode, scene, meshes, dir, textures_loaded);
+	Model::process_node(scene->mRootNode, scene, dir, state);
+
+	// Decoding dominates import time for textured models, so every image goes to the pool.
+	std::vector<std::future<std::expected<ImageData, std::string>>> jobs;
+	for (size_t i = 0; i < state.texture_sources.size(); i++) {
+		const auto& source = state.texture_sources[i];
+		jobs.push_back(pool.submit([&source, &options, type = state.data.images[i].type] {
+			auto image = source.embedded ? Model::gen_embedded_texture(source.embedded)
+			                             : Model::texture_from_path(source.file_path.c_str(), options);
+			if (image && options.compress_textures) {
+				image->type = type;
+				Model::compress_texture(*image, options);
+			}
+			return image;
+		}));
+	}
+	for (size_t i = 0; i < jobs.size(); i++) {
+		auto& image = state.data.images[i];
+		auto decoded = jobs[i].get();
+		if (!decoded) {
+			// Plain white is neutral for the shader, which multiplies maps together
+			std::println("{}", decoded.error());
+			decoded = ImageData {.width = 1, .height = 1, .channels = 4, .pixels = {255, 255, 255, 255}};
+		}
+		image.width = decoded->width;
+		image.height = decoded->height;
+		image.channels = decoded->channels;
+		image.encoding = decoded->encoding;
+		image.pixels = std::move(decoded->pixels);
+	}
+
+	return std::move(state.data);
+}
+
+Model Model::upload(const ModelSource& source, const ModelOptions& options) {
+	if (auto cache = std::get_if<MeshCache>(&source)) {
+		return Model::upload(cache->meshes, cache->images, cache->nodes, options);
+	}
+	const auto& data = std::get<ModelData>(source);
+	return Model::upload(data.mesh_views(), data.image_views(), data.nodes, options);
+}
 
-	return Model(std::move(meshes));
+Model& Model::placeholder() {
+	static Model model = [] {
+		std::vector<Vertex> verts;
+		std::vector<GLuint> indices;
+		for (int axis = 0; axis < 3; axis++) {
+			for (float sign: {-1.f, 1.f}) {
+				glm::vec3 normal(0.f), u(0.f), v(0.f);
+				normal[axis] = sign;
+				u[(axis + 1) % 3] = 0.5f;
+				v[(axis + 2) % 3] = 0.5f * sign;
+				GLuint base = verts.size();
+				for (auto [a, b]: {std::pair {-1.f, -1.f}, {1.f, -1.f}, {1.f, 1.f}, {-1.f, 1.f}}) {
+					verts.push_back(Vertex {
+					    .pos = normal * 0.5f + u * a + v * b,
+					    .normal = normal,
+					    .tex_coords = glm::vec2((a + 1.f) * 0.5f, (b + 1.f) * 0.5f),
+					});
+				}
+				indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+			}
+		}
+		std::vector<Mesh> meshes;
+		meshes.emplace_back(verts, indices, std::vector<Texture> {}, Bounds::from_vertices(verts));
+		return Model(std::move(meshes));
+	}();
+	return model;
 }
+
+Model Model::upload(
+    std::span<const MeshView> meshes,
+    std::span<const ImageView> images,
+    std::span<const SceneNode> nodes,
+    const ModelOptions& options
+) {
+	std::vector<Texture> textures;
+	for (const auto& image: images) {
+		textures.push_back(Model::upload_texture(image));
+	}
+
+	std::vector<Mesh> gl_meshes;
+	std::vector<uint32_t> mesh_nodes;
+	for (const auto& mesh: meshes) {
+		mesh_nodes.push_back(mesh.node);
+		std::vector<Texture> mesh_textures;
+		for (auto texture: mesh.textures) {
+			mesh_textures.push_back(textures[texture]);
+		}
+		gl_meshes.emplace_back(
+		    mesh.vertices,
+		    mesh.indices,
+		    std::move(mesh_textures),
+		    mesh.bounds,
+		    options.vertex_format,
+		    mesh.lods,
+		    mesh.meshlets
+		);
+	}
+
+	return Model(std::move(gl_meshes), nodes, std::move(mesh_nodes));
+}
+
 void Model::process_node(
     const aiNode* node,
     const aiScene* scene,
-    std::vector<Mesh>& meshes,
     const std::string& dir,
-    std::vector<Texture>& textures_loaded
+    ImportState& state,
+    uint32_t parent
 ) {
+	auto index = (uint32_t) state.data.nodes.size();
+	state.data.nodes.push_back(SceneNode {
+	    // Assimp matrices are row major, glm's column major
+	    .local = glm::transpose(glm::make_mat4(&node->mTransformation.a1)),
+	    .parent = parent,
+	});
+
 	for (uint32_t i = 0; i < node->mNumMeshes; i++) {
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(Model::process_mesh(mesh, scene, dir, textures_loaded));
+		auto& data = state.data.meshes.emplace_back(Model::process_mesh(mesh, scene, dir, state));
+		data.node = index;
 	}
 
 	for (uint32_t i = 0; i < node->mNumChildren; i++) {
-		Model::process_node(node->mChildren[i], scene, meshes, dir, textures_loaded);
+		Model::process_node(node->mChildren[i], scene, dir, state, index);
 	}
 }
-Mesh Model::process_mesh(
+MeshData Model::process_mesh(
     const aiMesh* mesh,
     const aiScene* scene,
     const std::string& dir,
-
-    std::vector<Texture>& textures_loaded
+    ImportState& state
 ) {
-	std::vector<Vertex> verts;
-	std::vector<GLuint> indices;
-	std::vector<Texture> textures;
+	MeshData mesh_data;
+	auto& verts = mesh_data.vertices;
+	auto& indices = mesh_data.indices;
+	auto& textures = mesh_data.textures;
 
+	verts.reserve(mesh->mNumVertices);
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
 		Vertex vert;
 		vert.pos.x = mesh->mVertices[i].x;
@@ -75,6 +450,8 @@ Mesh Model::process_mesh(
 		if (mesh->mTextureCoords[0]) {
 			vert.tex_coords.x = mesh->mTextureCoords[0][i].x;
 			vert.tex_coords.y = mesh->mTextureCoords[0][i].y;
+		} else {
+			vert.tex_coords = glm::vec2(0.f);
 		}
 
 		vert.normal.x = mesh->mNormals[i].x;
@@ -83,6 +460,7 @@ Mesh Model::process_mesh(
 
 		verts.push_back(std::move(vert));
 	}
+	indices.reserve(mesh->mNumFaces * 3);
 	for (size_t i = 0; i < mesh->mNumFaces; i++) {
 		const auto& face = mesh->mFaces[i];
 
@@ -90,173 +468,275 @@ Mesh Model::process_mesh(
 			indices.push_back(face.mIndices[j]);
 		}
 	}
+	// Point and line meshes are left alone, the optimizers expect triangle lists
+	if (state.options.optimize_meshes && indices.size() == mesh->mNumFaces * 3) {
+		auto before = analyze_vertex_cache(indices, verts.size());
+		indices = optimize_vertex_cache(indices, verts.size());
+		indices = optimize_overdraw(indices, verts);
+		optimize_vertex_fetch(verts, indices);
+		auto after = analyze_vertex_cache(indices, verts.size());
+		std::println(
+		    "{}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+		    mesh->mName.C_Str(),
+		    before.acmr,
+		    after.acmr,
+		    before.atvr,
+		    after.atvr
+		);
+	}
+	if (state.options.generate_lods && indices.size() == mesh->mNumFaces * 3) {
+		mesh_data.lods = build_lod_chain(indices, verts);
+		for (auto& lod: mesh_data.lods) {
+			if (state.options.optimize_meshes) {
+				lod.indices = optimize_vertex_cache(lod.indices, verts.size());
+			}
+			std::println(
+			    "{}: LOD {} triangles, error {:.4f}",
+			    mesh->mName.C_Str(),
+			    lod.indices.size() / 3,
+			    lod.error
+			);
+		}
+	}
+	if (state.options.build_meshlets && indices.size() == mesh->mNumFaces * 3) {
+		mesh_data.meshlets = build_meshlets(indices, verts);
+	}
+	mesh_data.bounds = Bounds::from_vertices(verts);
 	aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 	// 1. diffuse maps
-	std::vector<Texture> diffuse_maps = Model::load_material_textures(
+	std::vector<uint32_t> diffuse_maps = Model::load_material_textures(
 	    material,
 	    scene,
 	    aiTextureType_DIFFUSE,
 	    "texture_diffuse",
 	    dir,
-	    textures_loaded
+	    state
 	);
 	textures.insert(textures.end(), diffuse_maps.begin(), diffuse_maps.end());
 	// 2. specular maps
-	std::vector<Texture> specular_maps = Model::load_material_textures(
+	std::vector<uint32_t> specular_maps = Model::load_material_textures(
 	    material,
 	    scene,
 	    aiTextureType_SPECULAR,
 	    "texture_specular",
 	    dir,
-	    textures_loaded
+	    state
 	);
 	textures.insert(textures.end(), specular_maps.begin(), specular_maps.end());
 	// 3. normal maps
-	std::vector<Texture> normal_maps = Model::load_material_textures(
+	std::vector<uint32_t> normal_maps = Model::load_material_textures(
 	    material,
 	    scene,
 	    aiTextureType_HEIGHT,
 	    "texture_normal",
 	    dir,
-	    textures_loaded
+	    state
 	);
 	textures.insert(textures.end(), normal_maps.begin(), normal_maps.end());
 	// 4. height maps
-	std::vector<Texture> height_maps = Model::load_material_textures(
+	std::vector<uint32_t> height_maps = Model::load_material_textures(
 	    material,
 	    scene,
 	    aiTextureType_AMBIENT,
 	    "texture_height",
 	    dir,
-	    textures_loaded
+	    state
 	);
 	textures.insert(textures.end(), height_maps.begin(), height_maps.end());
 
-	return Mesh(std::move(verts), std::move(indices), std::move(textures));
+	return mesh_data;
 }
 
-std::vector<Texture> Model::load_material_textures(
+std::vector<uint32_t> Model::load_material_textures(
     const aiMaterial* mat,
     const aiScene* scene,
     aiTextureType type,
     const std::string& typeName,
     const std::string& dir,
-    std::vector<Texture>& textures_loaded
+    ImportState& state
 ) {
-	std::vector<Texture> textures;
+	auto& images = state.data.images;
+	std::vector<uint32_t> textures;
 	for (size_t i = 0; i < mat->GetTextureCount(type); i++) {
 		aiString path;
 		mat->GetTexture(type, i, &path);
 
 		const aiTexture* embedded_texture = scene->GetEmbeddedTexture(path.C_Str());
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-			if (std::strcmp(textures_loaded[j].path.data(), path.C_Str()) == 0) {
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
+		auto resolved = std::string(path.C_Str());
+		if (!embedded_texture) {
+			auto file = std::filesystem::path(dir) / path.C_Str();
+			std::error_code err;
+			auto canonical = std::filesystem::weakly_canonical(file, err);
+			resolved = (err ? file.lexically_normal() : canonical).string();
 		}
-		if (skip) continue;
-
-		if (embedded_texture) {
-			textures.push_back(std::move(gen_embedded_texture(embedded_texture, typeName, path.C_Str())));
-		} else {
-			textures.push_back(std::move(
-			    texture_from_path(std::format("{}/{}", dir, path.C_Str()).c_str(), typeName.c_str())
-			));
+		auto loaded = std::ranges::find_if(images, [&](const ImageData& image) {
+			return image.path == resolved && image.type == typeName;
+		});
+		if (loaded != images.end()) {
+			textures.push_back(loaded - images.begin());
+			continue;
 		}
+
+		// Only queued here, Model::import decodes all sources in parallel afterwards
+		textures.push_back(images.size());
+		images.push_back(ImageData {.type = typeName, .path = resolved});
+		state.texture_sources.push_back(TextureSource {
+		    .embedded = embedded_texture,
+		    .file_path = embedded_texture ? "" : resolved,
+		});
 	}
 	return textures;
 }
 
-Texture Model::texture_from_path(const char* path, const char* type_name) {
-	Texture m_texture;
-	GLuint id;
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	GLenum format;
-	stbi_set_flip_vertically_on_load(true);
-
-	int height;
-	int width;
-	int channels;
-	uint8_t* data = stbi_load(path, &width, &height, &channels, 0);
-	if (data) {
-		if (channels == 4) {
-			format = GL_RGBA;
-		} else if (channels == 3) {
-			format = GL_RGB;
-		}
-	} else {
-		std::println("Failed to load texture from path: {}", path);
-		return m_texture;
+std::expected<ImageData, std::string>
+Model::texture_from_path(const char* path, const ModelOptions& options) {
+	// Textures pre-encoded with `app tool compress` skip stb entirely, unless compression is off
+	auto ktx2_path = std::string(path);
+	if (ktx2_path.ends_with(".ktx2")) return Model::texture_from_ktx2(ktx2_path);
+	ktx2_path += ".ktx2";
+	if (options.compress_textures && std::filesystem::exists(ktx2_path)) {
+		return Model::texture_from_ktx2(ktx2_path);
 	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// Runs on worker threads, the flip flag has to be the thread-local one
+	stbi_set_flip_vertically_on_load_thread(true);
 
-	m_texture.id = id;
-	m_texture.type = std::move(type_name);
-	m_texture.path = path;
-
-	stbi_image_free(data);
+	ImageData image;
+	uint8_t* pixels = stbi_load(path, &image.width, &image.height, &image.channels, 0);
+	if (!pixels) {
+		return std::unexpected(std::format("Failed to load texture from path: {}", path));
+	}
+	image.pixels.assign(pixels, pixels + (size_t) image.width * image.height * image.channels);
+	stbi_image_free(pixels);
 
-	return m_texture;
+	return image;
 }
 
-Texture Model::gen_embedded_texture(
-    const aiTexture* texture,
-    const std::string type_name,
-    std::string path
-) {
-	Texture m_texture;
-	GLuint id;
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	GLenum format;
-	stbi_set_flip_vertically_on_load(false);
-
-	int height;
-	int width;
-	int channels;
-	uint8_t* data = stbi_load_from_memory(
+std::expected<ImageData, std::string> Model::gen_embedded_texture(const aiTexture* texture) {
+	stbi_set_flip_vertically_on_load_thread(false);
+
+	ImageData image;
+	uint8_t* pixels = stbi_load_from_memory(
 	    (stbi_uc*) texture->pcData,
 	    (int) texture->mWidth,
-	    &width,
-	    &height,
-	    &channels,
+	    &image.width,
+	    &image.height,
+	    &image.channels,
 	    0
 	);
-	if (data) {
-		if (channels == 4) {
-			format = GL_RGBA;
-		} else if (channels == 3) {
-			format = GL_RGB;
-		}
-	} else {
-		std::println("Failed to load texture from memory: {}", path);
-		return m_texture;
+	if (!pixels) {
+		return std::unexpected(
+		    std::format("Failed to load texture from memory: {}", texture->mFilename.C_Str())
+		);
 	}
+	image.pixels.assign(pixels, pixels + (size_t) image.width * image.height * image.channels);
+	stbi_image_free(pixels);
+
+	return image;
+}
+
+std::expected<ImageData, std::string> Model::texture_from_ktx2(const std::string& path) {
+	auto file = MappedFile::open(path);
+	if (!file) return std::unexpected(file.error());
+	auto ktx2 = parse_ktx2(file->bytes());
+	if (!ktx2) return std::unexpected(std::format("{}: {}", path, ktx2.error()));
+
+	return ImageData {
+	    .width = ktx2->width,
+	    .height = ktx2->height,
+	    .channels = 4,
+	    .encoding = ImageEncoding::Ktx2,
+	    .pixels = {file->bytes().begin(), file->bytes().end()},
+	};
+}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
+void Model::compress_texture(ImageData& image, const ModelOptions& options) {
+	if (image.encoding != ImageEncoding::Raw) return;
 
-	m_texture.id = id;
-	m_texture.type = std::move(type_name);
-	m_texture.path = path;
+	auto format = pick_block_format(
+	    image.pixels,
+	    image.channels,
+	    image.type == "texture_normal",
+	    options.high_quality_textures
+	);
+	auto compressed = compress_image(image.pixels, image.width, image.height, image.channels, format);
+	image.pixels = write_ktx2(compressed);
+	image.encoding = ImageEncoding::Ktx2;
+}
+
+Texture Model::upload_texture(const ImageView& image) {
+	auto handle = TextureCache::shared().acquire(image);
+	return Texture {
+	    .id = handle->id,
+	    .type = std::string(image.type),
+	    .path = std::string(image.path),
+	    .handle = std::move(handle),
+	};
+}
+
+ModelHandle::ModelHandle(
+    std::string path,
+    ModelOptions options,
+    std::future<std::expected<ModelSource, std::string>> pending
+)
+    : source_path(std::move(path))
+    , options(options)
+    , pending(std::move(pending)) {}
+
+ModelHandle ModelHandle::load(const std::string& path, const ModelOptions& options) {
+	// A dedicated thread rather than ThreadPool::shared, import itself blocks on pool jobs
+	return ModelHandle(
+	    path,
+	    options,
+	    std::async(std::launch::async, [path, options] { return Model::load(path, options); })
+	);
+}
 
-	stbi_image_free(data);
+bool ModelHandle::poll() {
+	if (model) return true;
+	if (!pending.valid()) return false;
+	if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
 
-	return m_texture;
+	auto source = pending.get();
+	if (!source) {
+		std::println("Failed to load {}: {}", source_path, source.error());
+		load_error = source.error();
+		return false;
+	}
+	model = Model::upload(*source, options);
+	return true;
+}
+
+void ModelHandle::draw(const Shader& shader) {
+	if (poll()) {
+		model->draw(shader);
+	} else {
+		Model::placeholder().draw(shader);
+	}
+}
+
+void ModelHandle::draw_instanced(const Shader& shader, InstanceBuffer& instances) {
+	if (poll()) {
+		model->draw_instanced(shader, instances);
+	} else {
+		Model::placeholder().draw_instanced(shader, instances);
+	}
+}
+
+void ModelHandle::enqueue(
+    RenderQueue& queue,
+    RenderQueue::Pass pass,
+    Shader& shader,
+    const DrawView& view
+) {
+	auto& target = poll() ? *model : Model::placeholder();
+	target.enqueue(queue, pass, shader, view);
+}
+
+void ModelHandle::draw(const Shader& shader, const DrawView& view) {
+	if (poll()) {
+		model->draw(shader, view);
+	} else {
+		Model::placeholder().draw(shader, view);
+	}
 }
@@ -1,14 +1,108 @@
 #include "point_light.hpp"
-#include <format>
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include "shader.hpp"
 
-void PointLight::set_shader_data(int index, const Shader& shader) const {
-	shader.setVec3(std::format("point_lights[{}].pos", index).c_str(), this->pos);
-	shader.setVec3(std::format("point_lights[{}].ambient", index).c_str(), this->ambient);
-	shader.setVec3(std::format("point_lights[{}].diffuse", index).c_str(), this->diffuse);
-	shader.setVec3(std::format("point_lights[{}].specular", index).c_str(), this->specular);
+namespace {
+GpuPointLight pack(const PointLight& light) {
+	return GpuPointLight {
+	    .pos = glm::vec4(light.pos, light.constant),
+	    .ambient = glm::vec4(light.ambient, light.linear),
+	    .diffuse = glm::vec4(light.diffuse, light.quadratic),
+	    .specular = glm::vec4(light.specular, light.range()),
+	};
+}
+} // namespace
+
+float PointLight::range() const {
+	float brightest = 0.f;
+	for (const auto& color: {ambient, diffuse, specular}) {
+		brightest = std::max({brightest, color.x, color.y, color.z});
+	}
+	// Solve constant + linear * d + quadratic * d^2 = brightest * 256
+	float c = constant - brightest * 256.f;
+	if (c >= 0.f) return 0.f;
+	if (quadratic > 0.f) {
+		return (-linear + std::sqrt(linear * linear - 4.f * quadratic * c)) / (2.f * quadratic);
+	}
+	if (linear > 0.f) return -c / linear;
+	return 1e18f;
+}
+
+size_t PointLightBuffer::add(const PointLight& light) {
+	lights.push_back(light);
+	mirror.push_back(pack(light));
+	mark_dirty(lights.size() - 1, lights.size());
+	return lights.size() - 1;
+}
+
+void PointLightBuffer::set(size_t index, const PointLight& light) {
+	lights[index] = light;
+	mirror[index] = pack(light);
+	mark_dirty(index, index + 1);
+}
+
+void PointLightBuffer::remove(size_t index) {
+	lights[index] = lights.back();
+	mirror[index] = mirror.back();
+	lights.pop_back();
+	mirror.pop_back();
+	if (index < lights.size()) mark_dirty(index, index + 1);
+}
+
+void PointLightBuffer::clear() {
+	lights.clear();
+	mirror.clear();
+	dirty_begin = dirty_end = 0;
+}
+
+void PointLightBuffer::mark_dirty(size_t begin, size_t end) {
+	if (dirty_begin == dirty_end) {
+		dirty_begin = begin;
+		dirty_end = end;
+		return;
+	}
+	dirty_begin = std::min(dirty_begin, begin);
+	dirty_end = std::max(dirty_end, end);
+}
+
+void PointLightBuffer::upload(const Shader& shader) {
+	counters.uploaded_bytes = 0;
+	if (!buffer) glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	if (mirror.size() > capacity || capacity == 0) {
+		capacity = std::bit_ceil(std::max<size_t>(mirror.size(), 64));
+		glBufferData(
+		    GL_SHADER_STORAGE_BUFFER,
+		    capacity * sizeof(GpuPointLight),
+		    nullptr,
+		    GL_DYNAMIC_DRAW
+		);
+		counters.reallocations++;
+		dirty_begin = 0;
+		dirty_end = mirror.size();
+	}
+	dirty_end = std::min(dirty_end, mirror.size());
+	if (dirty_begin < dirty_end) {
+		auto bytes = (dirty_end - dirty_begin) * sizeof(GpuPointLight);
+		glBufferSubData(
+		    GL_SHADER_STORAGE_BUFFER,
+		    dirty_begin * sizeof(GpuPointLight),
+		    bytes,
+		    mirror.data() + dirty_begin
+		);
+		counters.uploaded_bytes = bytes;
+	}
+	dirty_begin = dirty_end = 0;
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, buffer_binding, buffer);
+	shader.setInt("point_light_num", mirror.size());
+}
 
-	shader.setFloat(std::format("point_lights[{}].constant", index).c_str(), this->constant);
-	shader.setFloat(std::format("point_lights[{}].linear", index).c_str(), this->linear);
-	shader.setFloat(std::format("point_lights[{}].quadratic", index).c_str(), this->quadratic);
+PointLightBuffer::Stats PointLightBuffer::stats() const {
+	auto stats = counters;
+	stats.lights = lights.size();
+	stats.capacity = capacity;
+	return stats;
 }
@@ -1,4 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glad/gl.h>
 #include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
 #include "shader.hpp"
 struct PointLight {
 	glm::vec3 pos;
@@ -10,5 +17,54 @@ struct PointLight {
 	float linear;
 	float quadratic;
 
-	void set_shader_data(int index, const Shader& shader) const;
+	// Distance past which attenuation keeps every channel under 1/256.
+	float range() const;
+};
+
+// std430 entry of the light buffer, see PointLightData in shaders/frag.glsl.
+struct GpuPointLight {
+	glm::vec4 pos; // w: constant
+	glm::vec4 ambient; // w: linear
+	glm::vec4 diffuse; // w: quadratic
+	glm::vec4 specular; // w: range, see PointLight::range
+};
+static_assert(sizeof(GpuPointLight) == 64);
+
+// Point lights with a packed mirror of the shader storage buffer they're read from. Changes
+// mark a range dirty and upload() sends only that range, the buffer grows by doubling so
+// the shader has no light limit. GL thread only.
+class PointLightBuffer {
+public:
+	struct Stats {
+		size_t lights;
+		size_t capacity;
+		size_t uploaded_bytes; // by the last upload()
+		size_t reallocations;
+	};
+
+	static constexpr GLuint buffer_binding = 2;
+
+	size_t size() const { return lights.size(); }
+	const PointLight& operator[](size_t index) const { return lights[index]; }
+	std::span<const PointLight> all() const { return lights; }
+
+	size_t add(const PointLight& light);
+	void set(size_t index, const PointLight& light);
+	// Moves the last light into `index`.
+	void remove(size_t index);
+	void clear();
+	// Sends the dirty range and binds the buffer, sets point_light_num on `shader`.
+	void upload(const Shader& shader);
+	Stats stats() const;
+
+private:
+	void mark_dirty(size_t begin, size_t end);
+
+	std::vector<PointLight> lights;
+	std::vector<GpuPointLight> mirror;
+	size_t dirty_begin = 0;
+	size_t dirty_end = 0;
+	size_t capacity = 0;
+	GLuint buffer = 0;
+	Stats counters {};
 };
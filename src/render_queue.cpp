@@ -0,0 +1,192 @@
+#include "render_queue.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include "geometry_pool.hpp"
+#include "material_table.hpp"
+
+namespace {
+constexpr uint64_t depth_max = (1 << 24) - 1;
+
+uint64_t quantize_depth(float depth, float far_plane) {
+	return (uint64_t) (std::clamp(depth / far_plane, 0.f, 1.f) * depth_max);
+}
+
+// Vertex format and page, 8 bits
+uint64_t geometry_key(const Mesh& mesh) {
+	return ((mesh.format == VertexFormat::Compact) << 7) | std::min(mesh.page(), 127u);
+}
+} // namespace
+
+void radix_sort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+	scratch.resize(items.size());
+	for (int shift = 0; shift < 64; shift += 8) {
+		std::array<size_t, 256> counts {};
+		for (const auto& item: items) counts[(item.key >> shift) & 0xff]++;
+		if (std::ranges::find(counts, items.size()) != counts.end()) continue;
+
+		size_t offset = 0;
+		for (auto& count: counts) {
+			auto n = count;
+			count = offset;
+			offset += n;
+		}
+		for (const auto& item: items) scratch[counts[(item.key >> shift) & 0xff]++] = item;
+		items.swap(scratch);
+	}
+}
+
+void RenderQueue::begin(glm::vec3 camera_pos, glm::vec3 camera_forward, float far_plane) {
+	this->camera_pos = camera_pos;
+	this->camera_forward = glm::normalize(camera_forward);
+	this->far_plane = far_plane;
+	commands.clear();
+	meshlet_indices.clear();
+	last_stats = {};
+}
+
+void RenderQueue::submit(
+    Pass pass,
+    Shader& shader,
+    const Mesh& mesh,
+    const glm::mat4& model,
+    std::optional<std::span<const uint32_t>> visible_meshlets
+) {
+	auto first_meshlet = (uint32_t) meshlet_indices.size();
+	if (visible_meshlets) {
+		meshlet_indices.insert(
+		    meshlet_indices.end(),
+		    visible_meshlets->begin(),
+		    visible_meshlets->end()
+		);
+	}
+	commands.push_back(Command {
+	    .pass = pass,
+	    .shader = &shader,
+	    .mesh = &mesh,
+	    .model = model,
+	    .normal_matrix = glm::transpose(glm::inverse(glm::mat3(model))),
+	    // A shared material table binds once per program, leave the key to geometry and depth
+	    .material = MaterialTable::shared().active() ? (uint16_t) 0 : material_index(mesh),
+	    .meshlets_only = visible_meshlets.has_value(),
+	    .first_meshlet = first_meshlet,
+	    .meshlet_count = (uint32_t) (meshlet_indices.size() - first_meshlet),
+	});
+}
+
+uint32_t RenderQueue::program_index(GLuint program) {
+	auto [it, inserted] = programs.try_emplace(program, (uint32_t) programs.size());
+	return it->second & 0xff;
+}
+
+uint16_t RenderQueue::material_index(const Mesh& mesh) {
+	// Meshes with the same textures in the same order bind identically
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const auto& texture: mesh.textures) hash = (hash ^ texture.id) * 0x100000001b3ull;
+	if (materials.size() > 0xffff) materials.clear();
+	auto [it, inserted] = materials.try_emplace(hash, (uint16_t) materials.size());
+	return it->second;
+}
+
+uint64_t RenderQueue::make_key(const Command& command, uint32_t program, float depth) const {
+	auto quantized = quantize_depth(depth, far_plane);
+	uint64_t geometry = geometry_key(*command.mesh);
+	uint64_t pass = (uint64_t) command.pass << 60;
+
+	if (command.pass == Pass::Transparent) {
+		return pass | (depth_max - quantized) << 36 | (uint64_t) program << 28
+		     | (uint64_t) command.material << 12 | geometry << 4;
+	}
+	return pass | (uint64_t) program << 52 | (uint64_t) command.material << 36 | geometry << 28
+	     | quantized << 4;
+}
+
+void RenderQueue::execute() {
+	last_stats.draws += commands.size();
+	auto start = std::chrono::steady_clock::now();
+	items.clear();
+	for (uint32_t i = 0; i < commands.size(); i++) {
+		const auto& command = commands[i];
+		auto center = glm::vec3(command.model * glm::vec4(command.mesh->bounds.center, 1.f));
+		float depth = glm::dot(center - camera_pos, camera_forward);
+		items.push_back(SortItem {make_key(command, program_index(command.shader->id), depth), i});
+	}
+	radix_sort(items, scratch);
+	last_stats.sort_ms +=
+	    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	const Shader* shader = nullptr;
+	DrawUniforms uniforms;
+	int material = -1;
+	int geometry = -1;
+	for (const auto& item: items) {
+		const auto& command = commands[item.index];
+		const auto& mesh = *command.mesh;
+		bool program_changed = command.shader != shader;
+		if (program_changed) {
+			command.shader->use();
+			shader = command.shader;
+			uniforms = DrawUniforms {
+			    .model = shader->uniform<glm::mat4>("model"),
+			    .normal_matrix = shader->uniform<glm::mat3>("normalMatrix"),
+			    .material_index = shader->uniform<unsigned>("material_index"),
+			};
+			last_stats.program_changes++;
+		}
+		// Material uniforms belong to the program, so a program switch rebinds them too
+		if (program_changed || command.material != material) {
+			mesh.bind_textures(*shader);
+			material = command.material;
+			last_stats.material_changes++;
+		} else if (MaterialTable::shared().active()) {
+			shader->set(uniforms.material_index, mesh.material_index());
+		}
+		int mesh_geometry = (int) (mesh.page() * 2 + (mesh.format == VertexFormat::Compact));
+		if (mesh_geometry != geometry) last_stats.geometry_changes++;
+		geometry = mesh_geometry;
+
+		mesh.bind_geometry(*shader);
+		shader->set(uniforms.model, command.model);
+		shader->set(uniforms.normal_matrix, command.normal_matrix);
+		if (command.meshlets_only) {
+			mesh.draw_bound(
+			    std::span(meshlet_indices).subspan(command.first_meshlet, command.meshlet_count)
+			);
+		} else {
+			mesh.draw_bound();
+		}
+	}
+	commands.clear();
+	meshlet_indices.clear();
+}
+
+void RenderQueue::execute_positions(const Shader& shader) {
+	items.clear();
+	for (uint32_t i = 0; i < commands.size(); i++) {
+		const auto& command = commands[i];
+		if (command.pass != Pass::Opaque) continue;
+		auto center = glm::vec3(command.model * glm::vec4(command.mesh->bounds.center, 1.f));
+		float depth = glm::dot(center - camera_pos, camera_forward);
+		// Geometry above depth, nearest first within a page
+		auto key = geometry_key(*command.mesh) << 24 | quantize_depth(depth, far_plane);
+		items.push_back(SortItem {key, i});
+	}
+	radix_sort(items, scratch);
+
+	auto model = shader.uniform<glm::mat4>("model");
+	for (const auto& item: items) {
+		const auto& command = commands[item.index];
+		command.mesh->bind_positions(shader);
+		shader.set(model, command.model);
+		if (command.meshlets_only) {
+			command.mesh->draw_bound(
+			    std::span(meshlet_indices).subspan(command.first_meshlet, command.meshlet_count)
+			);
+		} else {
+			command.mesh->draw_bound();
+		}
+	}
+	last_stats.position_draws += items.size();
+}
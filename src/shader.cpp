@@ -1,4 +1,6 @@
 #include "shader.hpp"
+#include <algorithm>
+#include <bit>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -10,19 +12,60 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <print>
 
+namespace {
+// Samplers and images take their unit as an int
+bool set_as_int(GLenum type) {
+	switch (type) {
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_CUBE_SHADOW:
+	case GL_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_IMAGE_2D:
+	case GL_IMAGE_2D_ARRAY:
+	case GL_UNSIGNED_INT_IMAGE_2D: return true;
+	default: return false;
+	}
+}
+
+void insert_defines(std::string& code, const std::vector<std::string>& defines) {
+	if (defines.empty()) return;
+	std::string lines;
+	for (const auto& define: defines) lines += std::format("#define {}\n", define);
+	// #version has to stay the first line
+	auto line_end = code.find('\n');
+	code.insert(line_end == std::string::npos ? code.size() : line_end + 1, lines);
+}
+} // namespace
+
 Shader::Shader(GLuint id): id(id) {}
 Shader::~Shader() noexcept { glDeleteProgram(id); }
 
-Shader::Shader(Shader&& other) noexcept: id(std::exchange(other.id, 0)) {}
+Shader::Shader(Shader&& other) noexcept
+    : id(std::exchange(other.id, 0))
+    , uniform_table(std::move(other.uniform_table))
+    , block_table(std::move(other.block_table))
+    , slots(std::move(other.slots)) {}
 
 Shader& Shader::operator=(Shader&& other) noexcept {
 	if (this != &other) {
+		glDeleteProgram(id);
 		id = std::exchange(other.id, 0);
+		uniform_table = std::move(other.uniform_table);
+		block_table = std::move(other.block_table);
+		slots = std::move(other.slots);
 	}
 	return *this;
 }
-std::expected<Shader, std::string>
-Shader::create(const char* vertexPath, const char* fragmentPath) {
+std::expected<Shader, std::string> Shader::create(
+    const char* vertexPath,
+    const char* fragmentPath,
+    const std::vector<std::string>& defines
+) {
 	std::ifstream vertFile(vertexPath);
 	std::ifstream fragFile(fragmentPath);
 
@@ -41,6 +84,8 @@ Shader::create(const char* vertexPath, const char* fragmentPath) {
 	std::string fragmentCode, vertexCode;
 	vertexCode = vShaderStream.str();
 	fragmentCode = fShaderStream.str();
+	insert_defines(vertexCode, defines);
+	insert_defines(fragmentCode, defines);
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
 
@@ -73,55 +118,188 @@ Shader::create(const char* vertexPath, const char* fragmentPath) {
 	glDeleteShader(vert);
 	glDeleteShader(frag);
 
-	return Shader(id);
+	auto shader = Shader(id);
+	shader.reflect();
+	return shader;
+}
+
+std::expected<Shader, std::string>
+Shader::create_compute(const char* computePath, const std::vector<std::string>& defines) {
+	std::ifstream file(computePath);
+	if (!file.good()) return std::unexpected("Shader files not found");
+	std::stringstream stream;
+	stream << file.rdbuf();
+	auto code = stream.str();
+	insert_defines(code, defines);
+	const char* source = code.c_str();
+
+	auto compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &source, nullptr);
+	glCompileShader(compute);
+	auto compileRes = checkCompileErrors(compute, "Compute");
+	if (!compileRes) {
+		glDeleteShader(compute);
+		return std::unexpected(std::format("{}: {}", computePath, compileRes.error()));
+	}
+
+	auto id = glCreateProgram();
+	glAttachShader(id, compute);
+	glLinkProgram(id);
+	glDeleteShader(compute);
+	auto linkRes = checkCompileErrors(id, "Program");
+	if (!linkRes) {
+		glDeleteProgram(id);
+		return std::unexpected(linkRes.error());
+	}
+
+	auto shader = Shader(id);
+	shader.reflect();
+	return shader;
+}
+
+void Shader::reflect() {
+	GLint count = 0, max_name = 0;
+	glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(id, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name);
+	std::string name(std::max(max_name, 1), '\0');
+	static constexpr GLenum uniform_props[] = {GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE, GL_BLOCK_INDEX};
+	for (GLint i = 0; i < count; i++) {
+		GLint values[4];
+		glGetProgramResourceiv(id, GL_UNIFORM, i, 4, uniform_props, 4, nullptr, values);
+		// Block members are set through their buffer
+		if (values[3] != -1) continue;
+		GLsizei length = 0;
+		glGetProgramResourceName(id, GL_UNIFORM, i, name.size(), &length, name.data());
+		uniform_table.push_back(UniformInfo {
+		    .name = name.substr(0, length),
+		    .location = values[0],
+		    .type = (GLenum) values[1],
+		    .array_size = values[2],
+		});
+	}
+
+	for (GLenum interface: {GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK}) {
+		glGetProgramInterfaceiv(id, interface, GL_ACTIVE_RESOURCES, &count);
+		glGetProgramInterfaceiv(id, interface, GL_MAX_NAME_LENGTH, &max_name);
+		name.resize(std::max<size_t>(name.size(), max_name));
+		static constexpr GLenum block_props[] = {GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE};
+		for (GLint i = 0; i < count; i++) {
+			GLint values[2];
+			glGetProgramResourceiv(id, interface, i, 2, block_props, 2, nullptr, values);
+			GLsizei length = 0;
+			glGetProgramResourceName(id, interface, i, name.size(), &length, name.data());
+			block_table.push_back(BlockInfo {
+			    .name = name.substr(0, length),
+			    .interface = interface,
+			    .binding = values[0],
+			    .data_size = values[1],
+			});
+		}
+	}
+
+	// Arrays of basic types are reported once as "name[0]", their elements sit at consecutive
+	// locations. Each element and the bare name get their own slot.
+	size_t names = 0;
+	for (const auto& uniform: uniform_table) names += uniform.array_size + 1;
+	slots.assign(std::bit_ceil(std::max<size_t>(names * 2, 16)), Slot {});
+	for (const auto& uniform: uniform_table) {
+		std::string_view full = uniform.name;
+		insert(UniformName(full), uniform.location, uniform.type);
+		if (!full.ends_with("[0]")) continue;
+		auto base = UniformName(full.substr(0, full.size() - 3));
+		insert(base, uniform.location, uniform.type);
+		for (GLint element = 1; element < uniform.array_size; element++) {
+			insert(base.at(element), uniform.location + element, uniform.type);
+		}
+	}
 }
 
-void Shader::setBool(const char* name, bool v) const {
-	auto location = glGetUniformLocation(id, name);
-	glUniform1i(location, v);
+void Shader::insert(UniformName name, GLint location, GLenum type) {
+	size_t mask = slots.size() - 1;
+	for (size_t i = name.hash & mask;; i = (i + 1) & mask) {
+		if (slots[i].hash == 0 || slots[i].hash == name.hash) {
+			slots[i] = Slot {name.hash, location, type};
+			return;
+		}
+	}
 }
-void Shader::setInt(const char* name, int v) const {
-	auto location = glGetUniformLocation(id, name);
-	glUniform1i(location, v);
+
+const Shader::Slot* Shader::find(UniformName name) const {
+	if (slots.empty()) return nullptr;
+	size_t mask = slots.size() - 1;
+	for (size_t i = name.hash & mask; slots[i].hash != 0; i = (i + 1) & mask) {
+		if (slots[i].hash == name.hash) return &slots[i];
+	}
+	return nullptr;
 }
 
-void Shader::setFloat(const char* name, float v) const {
-	auto location = glGetUniformLocation(id, name);
-	glUniform1f(location, v);
+const Shader::BlockInfo* Shader::block(std::string_view name) const {
+	auto it = std::ranges::find(block_table, name, &BlockInfo::name);
+	return it != block_table.end() ? &*it : nullptr;
 }
 
-void Shader::setMat4(const char* name, float* v) const {
-	auto location = glGetUniformLocation(id, name);
+GLint Shader::location(UniformName name) const {
+	auto slot = find(name);
+	return slot ? slot->location : -1;
+}
 
-	glUniformMatrix4fv(location, 1, GL_FALSE, v);
+GLint Shader::typed_location(UniformName name, GLenum type) const {
+	auto slot = find(name);
+	if (!slot) return -1;
+	if (slot->type != type && !(type == GL_INT && set_as_int(slot->type))) {
+		std::println("Shader {}: uniform type {:#x} doesn't match {:#x}", id, slot->type, type);
+		return -1;
+	}
+	return slot->location;
 }
-void Shader::setMat4(const char* name, const glm::mat4& v) const {
-	auto location = glGetUniformLocation(id, name);
 
-	glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(v));
+void Shader::set(Uniform<bool> uniform, bool v) const { glUniform1i(uniform.location, v); }
+void Shader::set(Uniform<int> uniform, int v) const { glUniform1i(uniform.location, v); }
+void Shader::set(Uniform<unsigned> uniform, unsigned v) const { glUniform1ui(uniform.location, v); }
+void Shader::set(Uniform<float> uniform, float v) const { glUniform1f(uniform.location, v); }
+void Shader::set(Uniform<glm::vec2> uniform, const glm::vec2& v) const {
+	glUniform2f(uniform.location, v.x, v.y);
+}
+void Shader::set(Uniform<glm::vec3> uniform, const glm::vec3& v) const {
+	glUniform3f(uniform.location, v.x, v.y, v.z);
+}
+void Shader::set(Uniform<glm::uvec3> uniform, const glm::uvec3& v) const {
+	glUniform3ui(uniform.location, v.x, v.y, v.z);
+}
+void Shader::set(Uniform<glm::mat3> uniform, const glm::mat3& v) const {
+	glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(v));
+}
+void Shader::set(Uniform<glm::mat4> uniform, const glm::mat4& v) const {
+	glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(v));
 }
 
-void Shader::setMat3(const char* name, float* v) const {
-	auto location = glGetUniformLocation(id, name);
+void Shader::setBool(UniformName name, bool v) const { glUniform1i(location(name), v); }
+void Shader::setInt(UniformName name, int v) const { glUniform1i(location(name), v); }
+void Shader::setUint(UniformName name, unsigned v) const { glUniform1ui(location(name), v); }
+void Shader::setFloat(UniformName name, float v) const { glUniform1f(location(name), v); }
 
-	glUniformMatrix3fv(location, 1, GL_FALSE, v);
+void Shader::setMat4(UniformName name, float* v) const {
+	glUniformMatrix4fv(location(name), 1, GL_FALSE, v);
+}
+void Shader::setMat4(UniformName name, const glm::mat4& v) const {
+	glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(v));
 }
-void Shader::setMat3(const char* name, const glm::mat3& v) const {
-	auto location = glGetUniformLocation(id, name);
 
-	glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(v));
+void Shader::setMat3(UniformName name, float* v) const {
+	glUniformMatrix3fv(location(name), 1, GL_FALSE, v);
+}
+void Shader::setMat3(UniformName name, const glm::mat3& v) const {
+	glUniformMatrix3fv(location(name), 1, GL_FALSE, glm::value_ptr(v));
 }
 
 void Shader::use() { glUseProgram(id); }
 
-void Shader::setVec3(const char* name, float v1, float v2, float v3) const {
-	auto location = glGetUniformLocation(id, name);
-	glUniform3f(location, v1, v2, v3);
+void Shader::setVec3(UniformName name, float v1, float v2, float v3) const {
+	glUniform3f(location(name), v1, v2, v3);
 }
 
-void Shader::setVec3(const char* name, const glm::vec3& v) const {
-	auto location = glGetUniformLocation(id, name);
-	glUniform3f(location, v.x, v.y, v.z);
+void Shader::setVec3(UniformName name, const glm::vec3& v) const {
+	glUniform3f(location(name), v.x, v.y, v.z);
 }
 std::expected<void, std::string> Shader::checkCompileErrors(GLuint id, std::string type) {
 	char buff[1024];
@@ -0,0 +1,234 @@
+#include "simplifier.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <glm/geometric.hpp>
+
+namespace {
+// Symmetric 4x4 error quadric stored as its upper triangle.
+struct Quadric {
+	double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+	void add_plane(glm::vec3 n, double d) {
+		xx += n.x * n.x, xy += n.x * n.y, xz += n.x * n.z, xw += n.x * d;
+		yy += n.y * n.y, yz += n.y * n.z, yw += n.y * d;
+		zz += n.z * n.z, zw += n.z * d;
+		ww += d * d;
+	}
+	Quadric& operator+=(const Quadric& o) {
+		xx += o.xx, xy += o.xy, xz += o.xz, xw += o.xw, yy += o.yy;
+		yz += o.yz, yw += o.yw, zz += o.zz, zw += o.zw, ww += o.ww;
+		return *this;
+	}
+	// Sum of squared distances from `p` to the accumulated planes.
+	double error(glm::vec3 p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x + yy * y * y
+		         + 2 * yz * y * z + 2 * yw * y + zz * z * z + 2 * zw * z + ww;
+		return std::max(e, 0.0);
+	}
+};
+
+struct Collapse {
+	GLuint from;
+	GLuint to;
+	double cost;
+};
+
+uint64_t edge_key(GLuint a, GLuint b) {
+	if (a > b) std::swap(a, b);
+	return ((uint64_t) a << 32) | b;
+}
+
+template <typename T>
+struct BytesHash {
+	size_t operator()(const T& v) const {
+		std::array<uint32_t, sizeof(T) / 4> words;
+		std::memcpy(words.data(), &v, sizeof(T));
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (auto w: words) hash = (hash ^ w) * 0x100000001b3ull;
+		return hash;
+	}
+};
+template <typename T>
+struct BytesEqual {
+	bool operator()(const T& a, const T& b) const { return std::memcmp(&a, &b, sizeof(T)) == 0; }
+};
+} // namespace
+
+std::vector<GLuint> simplify(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t target_index_count,
+    float target_error,
+    float* result_error
+) {
+	double max_cost = (double) target_error * target_error;
+	double worst = 0.0;
+	size_t vertex_count = vertices.size();
+
+	// Weld exact duplicates, then find positions shared by vertices with different
+	// attributes. Those seams, like open borders, are locked so the surface doesn't tear.
+	std::vector<GLuint> canonical(vertex_count);
+	std::vector<GLuint> position_id(vertex_count);
+	std::vector<bool> locked(vertex_count, false);
+	{
+		std::unordered_map<Vertex, GLuint, BytesHash<Vertex>, BytesEqual<Vertex>> unique_vertices;
+		std::unordered_map<glm::vec3, GLuint, BytesHash<glm::vec3>, BytesEqual<glm::vec3>> positions;
+		for (GLuint v = 0; v < vertex_count; v++) {
+			canonical[v] = unique_vertices.try_emplace(vertices[v], v).first->second;
+			if (canonical[v] != v) continue;
+			auto [it, inserted] = positions.try_emplace(vertices[v].pos, v);
+			position_id[v] = it->second;
+			if (!inserted) locked[v] = locked[it->second] = true;
+		}
+	}
+
+	std::vector<GLuint> tris;
+	tris.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		GLuint a = canonical[indices[t]], b = canonical[indices[t + 1]], c = canonical[indices[t + 2]];
+		if (a == b || b == c || a == c) continue;
+		tris.insert(tris.end(), {a, b, c});
+	}
+
+	{
+		std::unordered_map<uint64_t, uint32_t> edge_uses;
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			for (size_t k = 0; k < 3; k++) {
+				edge_uses[edge_key(position_id[tris[t + k]], position_id[tris[t + (k + 1) % 3]])]++;
+			}
+		}
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			for (size_t k = 0; k < 3; k++) {
+				GLuint a = tris[t + k], b = tris[t + (k + 1) % 3];
+				if (edge_uses[edge_key(position_id[a], position_id[b])] == 1) locked[a] = locked[b] = true;
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertex_count);
+	for (size_t t = 0; t < tris.size(); t += 3) {
+		auto p0 = vertices[tris[t]].pos, p1 = vertices[tris[t + 1]].pos, p2 = vertices[tris[t + 2]].pos;
+		auto n = glm::cross(p1 - p0, p2 - p0);
+		float len = glm::length(n);
+		if (len == 0.f) continue;
+		n /= len;
+		for (size_t k = 0; k < 3; k++) quadrics[tris[t + k]].add_plane(n, -glm::dot(n, p0));
+	}
+
+	std::vector<GLuint> remap(vertex_count);
+	std::iota(remap.begin(), remap.end(), 0);
+	auto resolve = [&](GLuint v) {
+		while (remap[v] != v) v = remap[v] = remap[remap[v]];
+		return v;
+	};
+
+	std::vector<GLuint> adjacency_offsets, adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertex_count);
+
+	// Each pass collapses every vertex at most once, then compacts the triangle list
+	while (tris.size() > target_index_count) {
+		adjacency_offsets.assign(vertex_count + 1, 0);
+		for (auto v: tris) adjacency_offsets[v + 1]++;
+		std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+		adjacency.resize(tris.size());
+		{
+			std::vector<GLuint> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+			for (size_t i = 0; i < tris.size(); i++) adjacency[fill[tris[i]]++] = i / 3;
+		}
+
+		collapses.clear();
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			for (size_t k = 0; k < 3; k++) {
+				GLuint a = tris[t + k], b = tris[t + (k + 1) % 3];
+				// Interior edges show up once per adjacent triangle, keep one direction
+				if (a > b) continue;
+				Quadric q = quadrics[a];
+				q += quadrics[b];
+				double ab = locked[a] ? INFINITY : q.error(vertices[b].pos);
+				double ba = locked[b] ? INFINITY : q.error(vertices[a].pos);
+				if (std::isinf(ab) && std::isinf(ba)) continue;
+				collapses.push_back(ab <= ba ? Collapse {a, b, ab} : Collapse {b, a, ba});
+			}
+		}
+		std::ranges::sort(collapses, {}, &Collapse::cost);
+
+		std::fill(touched.begin(), touched.end(), false);
+		size_t triangles = tris.size() / 3, removed = 0, applied = 0;
+		for (const auto& collapse: collapses) {
+			if (collapse.cost > max_cost || (triangles - removed) * 3 <= target_index_count) break;
+			GLuint from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[to]) continue;
+
+			// Reject collapses that flip any surviving triangle around `from`
+			bool flips = false;
+			size_t collapsed = 0;
+			auto to_pos = vertices[to].pos;
+			for (GLuint i = adjacency_offsets[from]; i < adjacency_offsets[from + 1] && !flips; i++) {
+				size_t t = adjacency[i] * 3;
+				GLuint v[3] = {resolve(tris[t]), resolve(tris[t + 1]), resolve(tris[t + 2])};
+				if (v[0] == v[1] || v[1] == v[2] || v[0] == v[2]) continue;
+				if (v[0] == to || v[1] == to || v[2] == to) {
+					collapsed++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (size_t k = 0; k < 3; k++) {
+					p[k] = vertices[v[k]].pos;
+					q[k] = v[k] == from ? to_pos : p[k];
+				}
+				auto before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				auto after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.f;
+			}
+			if (flips) continue;
+
+			remap[from] = to;
+			quadrics[to] += quadrics[from];
+			touched[from] = touched[to] = true;
+			removed += collapsed;
+			applied++;
+			worst = std::max(worst, collapse.cost);
+		}
+		if (applied == 0) break;
+
+		size_t out = 0;
+		for (size_t t = 0; t < tris.size(); t += 3) {
+			GLuint a = resolve(tris[t]), b = resolve(tris[t + 1]), c = resolve(tris[t + 2]);
+			if (a == b || b == c || a == c) continue;
+			tris[out++] = a;
+			tris[out++] = b;
+			tris[out++] = c;
+		}
+		tris.resize(out);
+	}
+
+	if (result_error) *result_error = (float) std::sqrt(worst);
+	return tris;
+}
+
+std::vector<LodLevel> build_lod_chain(
+    std::span<const GLuint> indices,
+    std::span<const Vertex> vertices,
+    size_t max_levels
+) {
+	std::vector<LodLevel> levels;
+	size_t previous = indices.size();
+	for (size_t level = 0; level < max_levels; level++) {
+		size_t target = previous / 6 * 3;
+		if (target < 3) break;
+		// Every level starts from the full mesh so its error is measured against it
+		LodLevel lod;
+		lod.indices = simplify(indices, vertices, target, INFINITY, &lod.error);
+		if (lod.indices.empty() || lod.indices.size() * 10 > previous * 9) break;
+		previous = lod.indices.size();
+		levels.push_back(std::move(lod));
+	}
+	return levels;
+}
@@ -0,0 +1,187 @@
+#include "texture_cache.hpp"
+#include <algorithm>
+#include <bit>
+#include <print>
+#include <GLFW/glfw3.h>
+#include "ktx2.hpp"
+#include "mapped_file.hpp"
+#include "material_table.hpp"
+
+namespace {
+// BC1 and BC3 are an extension, not core, unlike BC5 and BC7
+bool s3tc_supported() {
+	static bool supported = glfwExtensionSupported("GL_EXT_texture_compression_s3tc");
+	return supported;
+}
+} // namespace
+
+GLTexture::GLTexture(
+    GLuint id,
+    size_t bytes,
+    int width,
+    int height,
+    int levels,
+    GLenum internal_format
+)
+    : id(id)
+    , bytes(bytes)
+    , width(width)
+    , height(height)
+    , levels(levels)
+    , internal_format(internal_format) {}
+
+GLTexture::~GLTexture() noexcept {
+	if (bindless_handle) MaterialTable::release_handle(bindless_handle);
+	glDeleteTextures(1, &id);
+}
+
+TextureCache& TextureCache::shared() {
+	static TextureCache cache;
+	return cache;
+}
+
+std::shared_ptr<GLTexture> TextureCache::acquire(const ImageView& image) {
+	// Models streaming out leave expired entries behind, drop them whenever the map has
+	// doubled since the last sweep so the cost stays constant per acquire
+	if (entries.size() >= sweep_size) {
+		std::erase_if(entries, [](const auto& item) { return item.second.expired(); });
+		sweep_size = std::max<size_t>(entries.size() * 2, 64);
+	}
+	auto key = Key {std::string(image.path), hash_bytes(image.pixels)};
+	auto& entry = entries[key];
+	if (auto texture = entry.lock()) {
+		counters.hits++;
+		counters.bytes_saved += texture->bytes;
+		return texture;
+	}
+
+	counters.misses++;
+	auto texture = TextureCache::upload(image);
+	counters.bytes_uploaded += texture->bytes;
+	entry = texture;
+	return texture;
+}
+
+TextureCache::Stats TextureCache::stats() const {
+	auto stats = counters;
+	stats.live_textures = 0;
+	for (const auto& [key, entry]: entries) {
+		if (!entry.expired()) stats.live_textures++;
+	}
+	return stats;
+}
+
+std::shared_ptr<GLTexture> TextureCache::upload(const ImageView& image) {
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if (image.encoding == ImageEncoding::Ktx2) {
+		auto ktx2 = parse_ktx2(image.pixels);
+		if (ktx2) return TextureCache::upload_compressed(id, *ktx2);
+		// Falls through to a raw upload of a single white texel
+		std::println("{}: {}", image.path, ktx2.error());
+	}
+
+	// Sized internal formats, so texture arrays can copy these with glCopyImageSubData
+	GLenum format = GL_RGBA;
+	GLenum internal_format = GL_RGBA8;
+	switch (image.channels) {
+	case 1: format = GL_RED, internal_format = GL_R8; break;
+	case 2: format = GL_RG, internal_format = GL_RG8; break;
+	case 3: format = GL_RGB, internal_format = GL_RGB8; break;
+	}
+
+	static constexpr uint8_t white[4] = {255, 255, 255, 255};
+	bool raw = image.encoding == ImageEncoding::Raw;
+	// Rows are tightly packed, the default 4 byte alignment would read past odd RGB rows
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	int width = raw ? image.width : 1;
+	int height = raw ? image.height : 1;
+	glTexImage2D(
+	    GL_TEXTURE_2D,
+	    0,
+	    raw ? internal_format : GL_RGBA8,
+	    width,
+	    height,
+	    0,
+	    raw ? format : GL_RGBA,
+	    GL_UNSIGNED_BYTE,
+	    raw ? image.pixels.data() : white
+	);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	return std::make_shared<GLTexture>(
+	    id,
+	    raw ? image.pixels.size() : sizeof(white),
+	    width,
+	    height,
+	    std::bit_width((unsigned) std::max(width, height)),
+	    raw ? internal_format : GL_RGBA8
+	);
+}
+
+std::shared_ptr<GLTexture> TextureCache::upload_compressed(GLuint id, const Ktx2View& image) {
+	// The whole chain is baked, so sample it rather than building mips here
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+
+	size_t bytes = 0;
+	bool s3tc = image.format == BlockFormat::BC1 || image.format == BlockFormat::BC3;
+	if (s3tc && !s3tc_supported()) {
+		// Expanded on the CPU instead, four or eight times the memory but the same pixels
+		for (size_t level = 0; level < image.levels.size(); level++) {
+			int width = std::max(image.width >> level, 1);
+			int height = std::max(image.height >> level, 1);
+			auto rgba = decompress_level(image.format, image.levels[level], width, height);
+			rgba.resize((size_t) width * height * 4);
+			glTexImage2D(
+			    GL_TEXTURE_2D,
+			    level,
+			    GL_RGBA8,
+			    width,
+			    height,
+			    0,
+			    GL_RGBA,
+			    GL_UNSIGNED_BYTE,
+			    rgba.data()
+			);
+			bytes += rgba.size();
+		}
+		return std::make_shared<GLTexture>(
+		    id,
+		    bytes,
+		    image.width,
+		    image.height,
+		    (int) image.levels.size(),
+		    GL_RGBA8
+		);
+	}
+
+	for (size_t level = 0; level < image.levels.size(); level++) {
+		glCompressedTexImage2D(
+		    GL_TEXTURE_2D,
+		    level,
+		    gl_internal_format(image.format),
+		    std::max(image.width >> level, 1),
+		    std::max(image.height >> level, 1),
+		    0,
+		    image.levels[level].size(),
+		    image.levels[level].data()
+		);
+		bytes += image.levels[level].size();
+	}
+	return std::make_shared<GLTexture>(
+	    id,
+	    bytes,
+	    image.width,
+	    image.height,
+	    (int) image.levels.size(),
+	    gl_internal_format(image.format)
+	);
+}
@@ -0,0 +1,384 @@
+#include "texture_compress.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace {
+using Block = std::array<std::array<float, 4>, 16>;
+
+// Principal axis of the block's colours, `dims` channels wide, by power iteration.
+std::array<float, 4> principal_axis(const Block& block, int dims, const std::array<float, 4>& mean) {
+	float cov[4][4] = {};
+	for (const auto& px: block) {
+		for (int i = 0; i < dims; i++) {
+			for (int j = 0; j < dims; j++) cov[i][j] += (px[i] - mean[i]) * (px[j] - mean[j]);
+		}
+	}
+	std::array<float, 4> axis = {1.f, 1.f, 1.f, dims == 4 ? 1.f : 0.f};
+	for (int iter = 0; iter < 8; iter++) {
+		std::array<float, 4> next = {};
+		for (int i = 0; i < dims; i++) {
+			for (int j = 0; j < dims; j++) next[i] += cov[i][j] * axis[j];
+		}
+		float len = 0.f;
+		for (int i = 0; i < dims; i++) len += next[i] * next[i];
+		// Flat block, any axis will do
+		if (len < 1e-12f) break;
+		len = std::sqrt(len);
+		for (int i = 0; i < dims; i++) axis[i] = next[i] / len;
+	}
+	return axis;
+}
+
+// Endpoints spanning the block along its principal axis.
+std::pair<std::array<float, 4>, std::array<float, 4>> fit_endpoints(const Block& block, int dims) {
+	std::array<float, 4> mean = {};
+	for (const auto& px: block) {
+		for (int i = 0; i < dims; i++) mean[i] += px[i] / 16.f;
+	}
+	auto axis = principal_axis(block, dims, mean);
+	float lo = 1e30f, hi = -1e30f;
+	for (const auto& px: block) {
+		float t = 0.f;
+		for (int i = 0; i < dims; i++) t += (px[i] - mean[i]) * axis[i];
+		lo = std::min(lo, t);
+		hi = std::max(hi, t);
+	}
+	std::array<float, 4> a = {}, b = {};
+	for (int i = 0; i < dims; i++) {
+		a[i] = std::clamp(mean[i] + axis[i] * hi, 0.f, 255.f);
+		b[i] = std::clamp(mean[i] + axis[i] * lo, 0.f, 255.f);
+	}
+	return {a, b};
+}
+
+template <size_t N>
+uint32_t nearest(const std::array<float, 4>& px, const std::array<std::array<float, 4>, N>& palette, int dims) {
+	uint32_t best = 0;
+	float best_dist = 1e30f;
+	for (uint32_t i = 0; i < N; i++) {
+		float dist = 0.f;
+		for (int c = 0; c < dims; c++) dist += (px[c] - palette[i][c]) * (px[c] - palette[i][c]);
+		if (dist < best_dist) {
+			best_dist = dist;
+			best = i;
+		}
+	}
+	return best;
+}
+
+uint16_t pack_565(const std::array<float, 4>& c) {
+	auto r = (uint16_t) std::lround(c[0] * 31.f / 255.f);
+	auto g = (uint16_t) std::lround(c[1] * 63.f / 255.f);
+	auto b = (uint16_t) std::lround(c[2] * 31.f / 255.f);
+	return (r << 11) | (g << 5) | b;
+}
+
+std::array<float, 4> unpack_565(uint16_t v) {
+	uint32_t r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	return {
+	    (float) ((r << 3) | (r >> 2)),
+	    (float) ((g << 2) | (g >> 4)),
+	    (float) ((b << 3) | (b >> 2)),
+	    255.f,
+	};
+}
+
+// Four colour BC1 block, which is also the colour half of BC3.
+void encode_bc1(const Block& block, uint8_t* out) {
+	auto [a, b] = fit_endpoints(block, 3);
+	uint16_t c0 = pack_565(a), c1 = pack_565(b);
+	// c0 > c1 selects the four colour mode
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		auto e0 = unpack_565(c0), e1 = unpack_565(c1);
+		std::array<std::array<float, 4>, 4> palette;
+		for (int c = 0; c < 3; c++) {
+			palette[0][c] = e0[c];
+			palette[1][c] = e1[c];
+			palette[2][c] = (2.f * e0[c] + e1[c]) / 3.f;
+			palette[3][c] = (e0[c] + 2.f * e1[c]) / 3.f;
+		}
+		for (int i = 0; i < 16; i++) indices |= nearest(block[i], palette, 3) << (2 * i);
+	}
+	std::memcpy(out, &c0, 2);
+	std::memcpy(out + 2, &c1, 2);
+	std::memcpy(out + 4, &indices, 4);
+}
+
+// Eight value BC4 block over one channel, the building block of BC3 alpha and BC5.
+void encode_bc4(const Block& block, int channel, uint8_t* out) {
+	float lo = 255.f, hi = 0.f;
+	for (const auto& px: block) {
+		lo = std::min(lo, px[channel]);
+		hi = std::max(hi, px[channel]);
+	}
+	auto a0 = (uint8_t) std::lround(hi), a1 = (uint8_t) std::lround(lo);
+
+	uint64_t indices = 0;
+	if (a0 != a1) {
+		std::array<std::array<float, 4>, 8> palette {};
+		palette[0][0] = a0;
+		palette[1][0] = a1;
+		for (int i = 2; i < 8; i++) palette[i][0] = ((8 - i) * a0 + (i - 1) * a1) / 7.f;
+		for (int i = 0; i < 16; i++) {
+			std::array<float, 4> value = {block[i][channel]};
+			indices |= (uint64_t) nearest(value, palette, 1) << (3 * i);
+		}
+	}
+	out[0] = a0;
+	out[1] = a1;
+	std::memcpy(out + 2, &indices, 6);
+}
+
+// BC7 mode 6: one subset, 7 bit rgba endpoints with a p-bit each and 4 bit indices.
+void encode_bc7(const Block& block, uint8_t* out) {
+	static constexpr int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+	auto [a, b] = fit_endpoints(block, 4);
+
+	std::array<std::array<uint32_t, 4>, 2> q;
+	std::array<uint32_t, 2> p;
+	std::array<std::array<float, 4>, 2> endpoints = {a, b};
+	for (int e = 0; e < 2; e++) {
+		float best_err = 1e30f;
+		for (uint32_t pbit = 0; pbit < 2; pbit++) {
+			std::array<uint32_t, 4> cand;
+			float err = 0.f;
+			for (int c = 0; c < 4; c++) {
+				cand[c] = (uint32_t) std::clamp(std::lround((endpoints[e][c] - pbit) / 2.f), 0l, 127l);
+				float recon = (float) (cand[c] * 2 + pbit);
+				err += (recon - endpoints[e][c]) * (recon - endpoints[e][c]);
+			}
+			if (err < best_err) {
+				best_err = err;
+				q[e] = cand;
+				p[e] = pbit;
+			}
+		}
+	}
+
+	std::array<std::array<float, 4>, 16> palette;
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			uint32_t e0 = q[0][c] * 2 + p[0], e1 = q[1][c] * 2 + p[1];
+			palette[i][c] = (float) (((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6);
+		}
+	}
+	std::array<uint32_t, 16> indices;
+	for (int i = 0; i < 16; i++) indices[i] = nearest(block[i], palette, 4);
+	// The first index has an implicit zero top bit
+	if (indices[0] & 8) {
+		std::swap(q[0], q[1]);
+		std::swap(p[0], p[1]);
+		for (auto& index: indices) index = 15 - index;
+	}
+
+	uint64_t bits[2] = {};
+	uint32_t pos = 0;
+	auto put = [&](uint64_t value, uint32_t count) {
+		for (uint32_t i = 0; i < count; i++, pos++) {
+			bits[pos / 64] |= ((value >> i) & 1) << (pos % 64);
+		}
+	};
+	put(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		put(q[0][c], 7);
+		put(q[1][c], 7);
+	}
+	put(p[0], 1);
+	put(p[1], 1);
+	put(indices[0], 3);
+	for (int i = 1; i < 16; i++) put(indices[i], 4);
+	std::memcpy(out, bits, 16);
+}
+
+// Colour half of a BC1 or BC3 block into 16 rgba texels. BC3 always uses four colours.
+void decode_bc1(const uint8_t* in, bool bc3, uint8_t* out) {
+	uint16_t c0, c1;
+	uint32_t indices;
+	std::memcpy(&c0, in, 2);
+	std::memcpy(&c1, in + 2, 2);
+	std::memcpy(&indices, in + 4, 4);
+	auto e0 = unpack_565(c0), e1 = unpack_565(c1);
+	std::array<std::array<float, 4>, 4> palette = {e0, e1};
+	bool four_colors = bc3 || c0 > c1;
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = four_colors ? (2.f * e0[c] + e1[c]) / 3.f : (e0[c] + e1[c]) / 2.f;
+		palette[3][c] = four_colors ? (e0[c] + 2.f * e1[c]) / 3.f : 0.f;
+	}
+	palette[2][3] = 255.f;
+	palette[3][3] = four_colors ? 255.f : 0.f;
+	for (int i = 0; i < 16; i++) {
+		const auto& color = palette[(indices >> (2 * i)) & 3];
+		for (int c = 0; c < 4; c++) out[i * 4 + c] = (uint8_t) std::lround(color[c]);
+	}
+}
+
+// BC4 block into `channel` of 16 rgba texels.
+void decode_bc4(const uint8_t* in, int channel, uint8_t* out) {
+	uint64_t indices = 0;
+	std::memcpy(&indices, in + 2, 6);
+	float a0 = in[0], a1 = in[1];
+	std::array<float, 8> palette = {a0, a1};
+	if (a0 > a1) {
+		for (int i = 2; i < 8; i++) palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7.f;
+	} else {
+		// Six interpolated values plus exact 0 and 255
+		for (int i = 2; i < 6; i++) palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5.f;
+		palette[6] = 0.f;
+		palette[7] = 255.f;
+	}
+	for (int i = 0; i < 16; i++) {
+		out[i * 4 + channel] = (uint8_t) std::lround(palette[(indices >> (3 * i)) & 7]);
+	}
+}
+
+std::vector<uint8_t> to_rgba(std::span<const uint8_t> pixels, int width, int height, int channels) {
+	size_t count = (size_t) width * height;
+	std::vector<uint8_t> rgba(count * 4);
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* src = &pixels[i * channels];
+		uint8_t* dst = &rgba[i * 4];
+		switch (channels) {
+		case 1: dst[0] = dst[1] = dst[2] = src[0], dst[3] = 255; break;
+		case 2: dst[0] = src[0], dst[1] = src[1], dst[2] = 0, dst[3] = 255; break;
+		case 3: dst[0] = src[0], dst[1] = src[1], dst[2] = src[2], dst[3] = 255; break;
+		default: std::memcpy(dst, src, 4); break;
+		}
+	}
+	return rgba;
+}
+
+std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, int width, int height) {
+	int w = std::max(width / 2, 1), h = std::max(height / 2, 1);
+	std::vector<uint8_t> out((size_t) w * h * 4);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int c = 0; c < 4; c++) {
+				uint32_t sum = rgba[((size_t) y0 * width + x0) * 4 + c]
+				             + rgba[((size_t) y0 * width + x1) * 4 + c]
+				             + rgba[((size_t) y1 * width + x0) * 4 + c]
+				             + rgba[((size_t) y1 * width + x1) * 4 + c];
+				out[((size_t) y * w + x) * 4 + c] = (uint8_t) ((sum + 2) / 4);
+			}
+		}
+	}
+	return out;
+}
+
+std::vector<uint8_t> encode_level(BlockFormat format, const std::vector<uint8_t>& rgba, int width, int height) {
+	int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	size_t size = block_bytes(format);
+	std::vector<uint8_t> out((size_t) blocks_x * blocks_y * size);
+	Block block;
+	for (int by = 0; by < blocks_y; by++) {
+		for (int bx = 0; bx < blocks_x; bx++) {
+			// Edge blocks repeat the last row/column
+			for (int i = 0; i < 16; i++) {
+				int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+				for (int c = 0; c < 4; c++) block[i][c] = rgba[((size_t) y * width + x) * 4 + c];
+			}
+			uint8_t* dst = &out[((size_t) by * blocks_x + bx) * size];
+			switch (format) {
+			case BlockFormat::BC1: encode_bc1(block, dst); break;
+			case BlockFormat::BC3:
+				encode_bc4(block, 3, dst);
+				encode_bc1(block, dst + 8);
+				break;
+			case BlockFormat::BC5:
+				encode_bc4(block, 0, dst);
+				encode_bc4(block, 1, dst + 8);
+				break;
+			case BlockFormat::BC7: encode_bc7(block, dst); break;
+			}
+		}
+	}
+	return out;
+}
+} // namespace
+
+size_t block_bytes(BlockFormat format) { return format == BlockFormat::BC1 ? 8 : 16; }
+
+GLenum gl_internal_format(BlockFormat format) {
+	switch (format) {
+	case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+BlockFormat pick_block_format(
+    std::span<const uint8_t> pixels,
+    int channels,
+    bool is_normal_map,
+    bool high_quality
+) {
+	if (is_normal_map || channels == 2) return BlockFormat::BC5;
+	bool has_alpha = false;
+	if (channels == 4) {
+		for (size_t i = 3; i < pixels.size() && !has_alpha; i += 4) has_alpha = pixels[i] != 255;
+	}
+	if (high_quality) return BlockFormat::BC7;
+	return has_alpha ? BlockFormat::BC3 : BlockFormat::BC1;
+}
+
+std::vector<uint8_t> decompress_level(
+    BlockFormat format,
+    std::span<const uint8_t> blocks,
+    int width,
+    int height
+) {
+	if (format != BlockFormat::BC1 && format != BlockFormat::BC3) return {};
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	size_t size = block_bytes(format);
+	if (blocks.size() < (size_t) blocks_x * blocks_y * size) return {};
+
+	std::vector<uint8_t> rgba((size_t) width * height * 4);
+	uint8_t texels[16 * 4];
+	for (int by = 0; by < blocks_y; by++) {
+		for (int bx = 0; bx < blocks_x; bx++) {
+			const uint8_t* block = blocks.data() + ((size_t) by * blocks_x + bx) * size;
+			if (format == BlockFormat::BC3) {
+				decode_bc1(block + 8, true, texels);
+				decode_bc4(block, 3, texels);
+			} else {
+				decode_bc1(block, false, texels);
+			}
+			// Edge blocks hang over the image, their extra texels are dropped
+			for (int y = 0; y < 4 && by * 4 + y < height; y++) {
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++) {
+					size_t texel = (size_t) (by * 4 + y) * width + bx * 4 + x;
+					std::memcpy(&rgba[texel * 4], &texels[(y * 4 + x) * 4], 4);
+				}
+			}
+		}
+	}
+	return rgba;
+}
+
+CompressedImage compress_image(
+    std::span<const uint8_t> pixels,
+    int width,
+    int height,
+    int channels,
+    BlockFormat format
+) {
+	CompressedImage image {.format = format, .width = width, .height = height};
+	auto rgba = to_rgba(pixels, width, height, channels);
+	while (true) {
+		image.levels.push_back(encode_level(format, rgba, width, height));
+		if (width == 1 && height == 1) break;
+		rgba = downsample(rgba, width, height);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	return image;
+}
@@ -0,0 +1,37 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+	threads = std::max<size_t>(threads, 1);
+	for (size_t i = 0; i < threads; i++) {
+		workers.emplace_back([this] { work(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (auto& worker: workers) worker.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock(mutex);
+			cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
@@ -0,0 +1,146 @@
+#include "tools.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <stb/image.h>
+#include "ktx2.hpp"
+#include "model.hpp"
+#include "simplifier.hpp"
+#include "texture_compress.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+// Encodes images to `<image>.ktx2`, which Model picks up instead of decoding the source.
+// Flags: --bc7 for colour maps, --normal to store two channel BC5.
+int tool_compress(std::span<char*> args) {
+	bool high_quality = false;
+	bool normal_map = false;
+	std::vector<std::string> paths;
+	for (std::string_view arg: args) {
+		if (arg == "--bc7") {
+			high_quality = true;
+		} else if (arg == "--normal") {
+			normal_map = true;
+		} else {
+			paths.emplace_back(arg);
+		}
+	}
+	if (paths.empty()) {
+		std::println("usage: app tool compress [--bc7] [--normal] <images...>");
+		return 1;
+	}
+
+	// Same orientation as Model::texture_from_path
+	stbi_set_flip_vertically_on_load(true);
+	for (const auto& path: paths) {
+		int width, height, channels;
+		uint8_t* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+		if (!pixels) {
+			std::println("Failed to load {}: {}", path, stbi_failure_reason());
+			return 1;
+		}
+		auto span = std::span<const uint8_t>(pixels, (size_t) width * height * channels);
+		auto format = pick_block_format(span, channels, normal_map, high_quality);
+		auto ktx2 = write_ktx2(compress_image(span, width, height, channels, format));
+		stbi_image_free(pixels);
+
+		auto out_path = path + ".ktx2";
+		std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+		out.write((const char*) ktx2.data(), ktx2.size());
+		if (!out.good()) {
+			std::println("Failed to write {}", out_path);
+			return 1;
+		}
+		std::println(
+		    "{}: {}x{} BC{} -> {} bytes ({:.1f}x smaller)",
+		    out_path,
+		    width,
+		    height,
+		    std::array {1, 3, 5, 7}[(size_t) format],
+		    ktx2.size(),
+		    (double) width * height * channels / ktx2.size()
+		);
+	}
+	return 0;
+}
+
+// Simplifies every mesh of the given models to a few target ratios and reports the
+// triangles kept against the error introduced, relative to the mesh size.
+int tool_simplify(std::span<char*> args) {
+	if (args.empty()) {
+		std::println("usage: app tool simplify <models...>");
+		return 1;
+	}
+
+	auto options = ModelOptions {.compress_textures = false, .generate_lods = false};
+	for (std::string_view path: args) {
+		auto data = Model::import(std::string(path), options, ThreadPool::shared());
+		if (!data) {
+			std::println("Failed to import {}: {}", path, data.error());
+			return 1;
+		}
+		for (size_t i = 0; i < data->meshes.size(); i++) {
+			const auto& mesh = data->meshes[i];
+			glm::vec3 lo(0.f), hi(0.f);
+			if (!mesh.vertices.empty()) lo = hi = mesh.vertices[0].pos;
+			for (const auto& vert: mesh.vertices) {
+				lo = glm::min(lo, vert.pos);
+				hi = glm::max(hi, vert.pos);
+			}
+			float extent = std::max(glm::length(hi - lo), 1e-6f);
+
+			size_t triangles = mesh.indices.size() / 3;
+			std::println("{} mesh {}: {} triangles", path, i, triangles);
+			for (float ratio: {0.5f, 0.25f, 0.1f, 0.05f, 0.01f}) {
+				float error;
+				auto start = std::chrono::steady_clock::now();
+				auto target = (size_t) (triangles * ratio) * 3;
+				auto lod = simplify(mesh.indices, mesh.vertices, target, INFINITY, &error);
+				std::chrono::duration<double, std::milli> elapsed =
+				    std::chrono::steady_clock::now() - start;
+				std::println(
+				    "  {:5.1f}%: {:8} triangles ({:5.1f}%), error {:.5f} ({:.3f}% of extent), {:.1f} ms",
+				    ratio * 100.f,
+				    lod.size() / 3,
+				    100.0 * lod.size() / std::max<size_t>(mesh.indices.size(), 1),
+				    error,
+				    100.f * error / extent,
+				    elapsed.count()
+				);
+			}
+		}
+	}
+	return 0;
+}
+
+struct Tool {
+	const char* name;
+	std::function<int(std::span<char*>)> run;
+};
+
+const std::vector<Tool> tools = {
+    {"compress", tool_compress},
+    {"simplify", tool_simplify},
+};
+} // namespace
+
+int run_tool(std::span<char*> args) {
+	if (!args.empty()) {
+		for (const auto& tool: tools) {
+			if (args[0] == std::string_view(tool.name)) return tool.run(args.subspan(1));
+		}
+	}
+	std::println("usage: app tool <name> [args...]");
+	for (const auto& tool: tools) std::println("  {}", tool.name);
+	return 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <span>
+
+// Headless asset tools, run as `app tool <name> [args...]`.
+int run_tool(std::span<char*> args);
@@ -0,0 +1,46 @@
+#include "transform_hierarchy.hpp"
+#include <algorithm>
+#include <glm/matrix.hpp>
+
+uint32_t TransformHierarchy::add(const glm::mat4& local, uint32_t parent) {
+	auto node = (uint32_t) parents.size();
+	parents.push_back(parent);
+	locals.push_back(local);
+	worlds.push_back(local);
+	normals.emplace_back(1.f);
+	dirty.push_back(1);
+	first_dirty = std::min<size_t>(first_dirty, node);
+	return node;
+}
+
+void TransformHierarchy::set_local(uint32_t node, const glm::mat4& local) {
+	locals[node] = local;
+	dirty[node] = 1;
+	first_dirty = std::min<size_t>(first_dirty, node);
+}
+
+void TransformHierarchy::clear() {
+	parents.clear();
+	locals.clear();
+	worlds.clear();
+	normals.clear();
+	dirty.clear();
+	first_dirty = std::numeric_limits<size_t>::max();
+}
+
+size_t TransformHierarchy::update() {
+	if (first_dirty >= parents.size()) return 0;
+	size_t updated = 0;
+	for (size_t node = first_dirty; node < parents.size(); node++) {
+		auto parent = parents[node];
+		// Parents come first, so a dirty one has already passed its flag on by now
+		if (parent != no_parent && dirty[parent]) dirty[node] = 1;
+		if (!dirty[node]) continue;
+		worlds[node] = parent == no_parent ? locals[node] : worlds[parent] * locals[node];
+		normals[node] = glm::transpose(glm::inverse(glm::mat3(worlds[node])));
+		updated++;
+	}
+	std::fill(dirty.begin() + first_dirty, dirty.end(), 0);
+	first_dirty = std::numeric_limits<size_t>::max();
+	return updated;
+}